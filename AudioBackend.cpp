@@ -0,0 +1,110 @@
+#include "AudioBackend.h"
+#include "Mixer.h"
+#include "Telemetry.h"
+#include <spdlog/spdlog.h>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+// rate of the open stream, for turning buffer sizes into time
+static std::atomic<float> stream_rate_kHz{DEFAULT_SAMPLERATE_kHz};
+
+void list_audio_devices() {
+    int count = Pa_GetDeviceCount();
+    int default_output = Pa_GetDefaultOutputDevice();
+    for (int i = 0; i < count; ++i) {
+        const PaDeviceInfo *device = Pa_GetDeviceInfo(i);
+        if (device == nullptr || device->maxOutputChannels < 2) {
+            continue;
+        }
+        spdlog::info("{}{}: {} ({}), {:.0f} Hz, latency {:.1f}-{:.1f} ms", i, i == default_output ? "*" : "",
+                     device->name, Pa_GetHostApiInfo(device->hostApi)->name, device->defaultSampleRate,
+                     device->defaultLowOutputLatency * 1000, device->defaultHighOutputLatency * 1000);
+    }
+}
+
+int find_audio_device(const char *name) {
+    char *end;
+    long index = std::strtol(name, &end, 10);
+    int count = Pa_GetDeviceCount();
+    if (*name != 0 && *end == 0) {
+        return index >= 0 && index < count ? static_cast<int>(index) : -1;
+    }
+    for (int i = 0; i < count; ++i) {
+        const PaDeviceInfo *device = Pa_GetDeviceInfo(i);
+        if (device != nullptr && device->maxOutputChannels >= 2 && std::strstr(device->name, name) != nullptr) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+PaStream *open_audio_stream(const AudioConfig &config, Mixer &mixer, AudioStreamInfo &info) {
+    PaStreamParameters output = {};
+    output.device = config.device >= 0 ? config.device : Pa_GetDefaultOutputDevice();
+    const PaDeviceInfo *device = output.device == paNoDevice ? nullptr : Pa_GetDeviceInfo(output.device);
+    if (device == nullptr) {
+        spdlog::error("no audio output device");
+        return nullptr;
+    }
+    output.channelCount = 2;
+    output.sampleFormat = paFloat32;
+    output.suggestedLatency = config.low_latency ? device->defaultLowOutputLatency : device->defaultHighOutputLatency;
+    output.hostApiSpecificStreamInfo = nullptr;
+
+    double rate = config.sample_rate_kHz * 1000.0;
+    PaError err = Pa_IsFormatSupported(nullptr, &output, rate);
+    if (err != paFormatIsSupported) {
+        spdlog::error("{} can't play stereo float at {:.0f} Hz: {}", device->name, rate, Pa_GetErrorText(err));
+        return nullptr;
+    }
+
+    // the engine has to be at the stream's rate before the first callback
+    for (size_t p = 0; p < mixer.part_count(); ++p) {
+        mixer.part(p).set_sample_rate(config.sample_rate_kHz);
+    }
+    stream_rate_kHz.store(config.sample_rate_kHz);
+
+    PaStream *stream = nullptr;
+    unsigned long frames = config.buffer_frames > 0 ? config.buffer_frames : paFramesPerBufferUnspecified;
+    PaStreamFlags flags = config.low_latency ? paClipOff | paDitherOff : paNoFlag;
+    err = Pa_OpenStream(&stream, nullptr, &output, rate, frames, flags, audioCallback, &mixer);
+    if (err != paNoError) {
+        spdlog::error("could not open {} at {:.0f} Hz, {} frames: {}", device->name, rate, config.buffer_frames,
+                      Pa_GetErrorText(err));
+        return nullptr;
+    }
+
+    const PaStreamInfo *stream_info = Pa_GetStreamInfo(stream);
+    info.sample_rate_kHz = static_cast<float>(stream_info->sampleRate / 1000);
+    info.buffer_frames = config.buffer_frames;
+    info.output_latency_ms = static_cast<float>(stream_info->outputLatency * 1000);
+    spdlog::info("audio: {} at {:.0f} Hz, {} frame buffers, output latency {:.2f} ms ({:.2f} ms requested{})",
+                 device->name, stream_info->sampleRate, config.buffer_frames, info.output_latency_ms,
+                 output.suggestedLatency * 1000, config.low_latency ? ", low latency mode" : "");
+    return stream;
+}
+
+int audioCallback(const void *inputBuffer, void *outputBuffer,
+                  unsigned long framesPerBuffer,
+                  const PaStreamCallbackTimeInfo *timeInfo,
+                  PaStreamCallbackFlags statusFlags,
+                  void *userData) {
+    auto start = std::chrono::steady_clock::now();
+    Mixer &mixer = *static_cast<Mixer *>(userData);
+
+    mixer.sync_frame_clock(framesPerBuffer);
+    mixer.render(std::span<float>(static_cast<float *>(outputBuffer), 2 * framesPerBuffer));
+
+    std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    float buffer_ms = framesPerBuffer / stream_rate_kHz.load(std::memory_order_relaxed);
+    float dac_lead_ms = timeInfo ? static_cast<float>((timeInfo->outputBufferDacTime - timeInfo->currentTime) * 1000) : 0.0f;
+    telemetry_record({
+            .load = elapsed.count() / buffer_ms,
+            .dac_lead_ms = dac_lead_ms,
+            .voices = static_cast<unsigned short>(mixer.get_active_voice_count()),
+            .status = statusFlags
+    });
+    return paContinue;
+}
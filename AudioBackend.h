@@ -0,0 +1,47 @@
+#ifndef AUDIO_BACKEND_H
+#define AUDIO_BACKEND_H
+
+#include "AudioEngine.h"
+#include <portaudio.h>
+
+class Mixer;
+
+// What to open. Anything the device can't do makes open_audio_stream() fail
+// rather than quietly running at some other rate.
+struct AudioConfig {
+    int device = -1;  // PortAudio device index, -1 for the default output
+    float sample_rate_kHz = DEFAULT_SAMPLERATE_kHz;
+    unsigned long buffer_frames = 256;  // 0 lets the host pick, possibly varying per callback
+    // ask for the device's lowest suggested latency instead of its safe default,
+    // and skip PortAudio's clipping and dither
+    bool low_latency = false;
+};
+
+// what the stream actually ended up with
+struct AudioStreamInfo {
+    float sample_rate_kHz;
+    unsigned long buffer_frames;   // 0 if the host picks
+    float output_latency_ms;       // as reported by the host, buffering included
+};
+
+// Logs every device with an output, with index, host API and default latencies
+void list_audio_devices();
+
+// index of the output device whose name contains name, or whose index it is,
+// -1 if there is none
+int find_audio_device(const char *name);
+
+// Opens (without starting) a stereo float stream rendering mixer, and sets
+// every mixer part to the stream's sample rate. Returns nullptr and logs on
+// failure. Pa_Initialize() must have been called.
+PaStream *open_audio_stream(const AudioConfig &config, Mixer &mixer, AudioStreamInfo &info);
+
+// PortAudio stream callback, renders the Mixer passed as userData straight
+// into the output buffer
+int audioCallback(const void *inputBuffer, void *outputBuffer,
+                  unsigned long framesPerBuffer,
+                  const PaStreamCallbackTimeInfo *timeInfo,
+                  PaStreamCallbackFlags statusFlags,
+                  void *userData);
+
+#endif  // AUDIO_BACKEND_H
@@ -2,18 +2,35 @@
 #include <cmath>
 #include <algorithm>
 #include <spdlog/spdlog.h>
-#include <vector>
 #include <map>
 #include <array>
-#include "public.sdk/source/vst2.x/audioeffectx.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include "SpscQueue.h"
+#include "TripleBuffer.h"
+#include "VoicePool.h"
+#include "OscillatorKernel.h"
+#include "Wavetable.h"
+#include "Biquad.h"
+#include "ControlRate.h"
+#include "WorkerPool.h"
+#include "Decimator.h"
+#include "EnvelopeGenerator.h"
+#include "PatchBank.h"
+#include "EventRecorder.h"
+#include "Effects.h"
 
-enum EnvelopeStage {
-    ATTACK, DECAY, SUSTAIN, RELEASE
+enum NoteEventType {
+    NOTE_ON, NOTE_OFF
 };
 
-struct Note {
-    int key;
-    int velocity;
+struct NoteEvent {
+    NoteEventType type;
+    unsigned short key;
+    unsigned short velocity;
+    uint64_t frame;  // engine frame the event takes effect at
+    std::chrono::steady_clock::time_point received = {};  // remote events only, for latency tracking
 };
 
 struct Envelope {
@@ -26,317 +43,1467 @@ struct Envelope {
 struct LFO {
     float frequency;
     float amplitude;
-    float phase;
 };
 
 struct Filter {
     float cutoff;
     float Q;
+    bool bypass;
+    float key_track;  // 0..1, see voice_filter_coefficients()
+    float velocity;   // 0..1
 };
 
-struct Sound {
-    float frequency;
-    float phase;
-    float max_vol;
-    float vol;
-    float vol_step;
-    bool note_on;
-    EnvelopeStage stage;
+struct Delay {
+    float time;  // ms
+    float feedback;
+    float mix;
+};
+
+struct Reverb {
+    float time;  // ms to -60 dB
+    float damping;
+    float mix;
+};
+
+struct Unison {
+    float voices;  // oscillators per voice, rounded to a whole number
+    float detune;  // cents
+    float spread;  // 0..1
+};
+
+// Everything the set_* functions control. The GUI edits its own copy and
+// publishes it whole; the audio thread picks up one consistent snapshot at the
+// top of each buffer and uses it for the entire buffer.
+struct SynthParams {
+    std::array<float, 256> key_freq_map;
+    Envelope envelope;
+    LFO vol_lfo;
+    LFO filter_cutoff_lfo;
+    Filter filter;
+    Delay delay;
+    Reverb reverb;
+    Unison unison;
+    float p_sin;
+    float p_saw;
+    float p_square;
+    unsigned control_interval;  // samples between modulation updates
+    unsigned max_polyphony;
+    StealPolicy steal_policy;
+    unsigned oversampling;  // 1, 2 or 4
+    float sample_rate_kHz;  // output rate
+    uint32_t program;  // bumped by every load_patch(), see WaveFade
+    // master gain change_volume() heads for, over gain_ramp_ms
+    float gain_target;
+    float gain_ramp_ms;
+    uint32_t gain_change;  // bumped by every change_volume()
+};
+
+// where each registry parameter lives in SynthParams
+static float *param_field(SynthParams &p, ParamId id) {
+    switch (id) {
+        case PARAM_ATTACK: return &p.envelope.attack;
+        case PARAM_DECAY: return &p.envelope.decay;
+        case PARAM_SUSTAIN: return &p.envelope.sustain;
+        case PARAM_RELEASE: return &p.envelope.release;
+        case PARAM_VOL_LFO_FREQUENCY: return &p.vol_lfo.frequency;
+        case PARAM_VOL_LFO_AMPLITUDE: return &p.vol_lfo.amplitude;
+        case PARAM_CUTOFF_LFO_FREQUENCY: return &p.filter_cutoff_lfo.frequency;
+        case PARAM_CUTOFF_LFO_AMPLITUDE: return &p.filter_cutoff_lfo.amplitude;
+        case PARAM_SIN: return &p.p_sin;
+        case PARAM_SAW: return &p.p_saw;
+        case PARAM_SQUARE: return &p.p_square;
+        case PARAM_CUTOFF: return &p.filter.cutoff;
+        case PARAM_Q: return &p.filter.Q;
+        case PARAM_DELAY_TIME: return &p.delay.time;
+        case PARAM_DELAY_FEEDBACK: return &p.delay.feedback;
+        case PARAM_DELAY_MIX: return &p.delay.mix;
+        case PARAM_REVERB_TIME: return &p.reverb.time;
+        case PARAM_REVERB_DAMPING: return &p.reverb.damping;
+        case PARAM_REVERB_MIX: return &p.reverb.mix;
+        case PARAM_UNISON_VOICES: return &p.unison.voices;
+        case PARAM_UNISON_DETUNE: return &p.unison.detune;
+        case PARAM_UNISON_SPREAD: return &p.unison.spread;
+        case PARAM_FILTER_KEY_TRACK: return &p.filter.key_track;
+        case PARAM_FILTER_VELOCITY: return &p.filter.velocity;
+        default: return nullptr;
+    }
+}
+
+static void write_param(SynthParams &p, ParamId id, float value) {
+    if (id == PARAM_FILTER_BYPASS) {
+        p.filter.bypass = value >= 0.5f;
+    } else if (float *field = param_field(p, id)) {
+        *field = value;
+    }
+}
+
+static float read_param(const SynthParams &p, ParamId id) {
+    if (id == PARAM_FILTER_BYPASS) {
+        return p.filter.bypass ? 1.0f : 0.0f;
+    }
+    return *param_field(const_cast<SynthParams &>(p), id);
+}
+
+// Polyphony cap. Stolen voices fade out over STEAL_FADE_ms and don't count
+// against the cap while they do, but at most MAX_STEAL_FADES fade at once (past
+// that the quietest fade is cut), so a callback never renders more than
+// max_polyphony + MAX_STEAL_FADES voices.
+constexpr unsigned DEFAULT_POLYPHONY = 64;
+constexpr float DEFAULT_GAIN = 0.5f;
+constexpr float STEAL_FADE_ms = 5;
+constexpr size_t MAX_STEAL_FADES = 16;
+
+// Ties engine frames to the wall clock for note_on()/note_off(). The audio
+// callback publishes it at the top of every buffer; events are scheduled one
+// buffer after the time they were played, which makes the latency constant
+// instead of jittering with where in the buffer they arrived.
+struct FrameClock {
+    bool valid;
+    std::chrono::steady_clock::time_point time;
+    uint64_t frame;
+    unsigned long buffer_frames;
+    float rate_kHz;  // output rate the frames run at
+};
+// how far past the last published buffer an event can be scheduled, guards
+// against a stale clock (stream stopped) holding events back
+constexpr unsigned long MAX_EVENT_LEAD_BUFFERS = 4;
+
+// Note events are timestamped in engine frames and render() splits the
+// voice rendering at each one, so timing doesn't depend on the buffer size.
+// Each producer thread gets its own input: a queue to the audio thread and its
+// own copy of the frame clock to read. A queue is FIFO and its timestamps only
+// go forward, so at most one popped event per input ever waits for a later block.
+enum NoteInputId {
+    INPUT_GUI, INPUT_REMOTE, NOTE_INPUTS
+};
+
+struct NoteInput {
+    SpscQueue<NoteEvent, 1024> queue;
+    TripleBuffer<FrameClock> clock;
+    NoteEvent held;
+    bool has_held = false;
+};
+constexpr uint64_t NO_EVENT = UINT64_MAX;
+
+// every waveform specialization of the widest oscillator kernel this CPU runs
+// correctly, picked once at startup and shared by every engine, mono and stereo
+static const OscKernelType oscillator_kernel_type = select_oscillator_kernel();
+const OscKernelTable &oscillator_kernels = *get_oscillator_kernels(oscillator_kernel_type);
+const StereoOscKernelTable &stereo_oscillator_kernels = *get_stereo_oscillator_kernels(oscillator_kernel_type);
+
+// oscillators per voice for params, 1..MAX_UNISON
+static size_t unison_count(const SynthParams &params) {
+    return static_cast<size_t>(std::clamp<long>(std::lround(params.unison.voices), 1, MAX_UNISON));
+}
+
+// A spread stack puts its oscillators at different places in the stereo field,
+// which takes a stereo voice mix. Otherwise the voices stay mono.
+static bool unison_stereo(const SynthParams &params) {
+    return unison_count(params) > 1 && params.unison.spread > 0;
+}
+
+// Start phase of oscillator k of a new stack: the first at 0 like a lone
+// oscillator, the rest scattered so the stack doesn't start out as one in-phase
+// spike. Hashed from the note's start order, so renders stay repeatable.
+static uint32_t unison_phase(uint32_t started, size_t k) {
+    if (k == 0) {
+        return 0;
+    }
+    uint32_t x = started * 0x9E3779B9u + static_cast<uint32_t>(k) * 0x85EBCA6Bu;
+    x ^= x >> 16;
+    x *= 0x7FEB352Du;
+    x ^= x >> 15;
+    return x;
+}
+
+// Filter key tracking and velocity. With either in use the filter goes per
+// voice: every oscillator gets a lane of its own (see BiquadLanes) between its
+// waveform and its envelope, and the filter on the mix is left out. At full
+// key tracking the cutoff follows the note's pitch, as set for a note at
+// KEY_TRACK_CENTRE_kHz (middle C). At full velocity amount a note of velocity
+// 0 sits VELOCITY_OCTAVES below one of 255.
+constexpr float KEY_TRACK_CENTRE_kHz = 0.2616f;
+constexpr float VELOCITY_OCTAVES = 4;
+
+static bool voice_filter(const SynthParams &params) {
+    return !params.filter.bypass && (params.filter.key_track != 0 || params.filter.velocity != 0);
+}
+
+// Control rate modulation state, audio thread only. LFOs, filter coefficients
+// and gains are evaluated at control points and ramped linearly in between.
+struct Modulation {
+    double vol_lfo_phase = 0;            // radians
+    double filter_cutoff_lfo_phase = 0;  // radians
+    // the cutoff LFO for the voice filters, which go with the voices instead
+    // of the control points: its phase where the voices being rendered start
+    double voice_filter_lfo_phase = 0;
+    unsigned countdown = 0;  // samples left until the next control point
+    bool primed = false;     // false until the first control point, nothing to ramp from
+    Ramp lfo_gain;
+    Ramp master_gain;
+    Ramp b0, b1, b2, a1, a2;
 };
 
-std::array<float, 256> key_freq_map = {};
-std::vector<Note> note_on_buffer = {};
-std::vector<unsigned short> note_off_buffer = {};
-std::array<std::optional<Sound>, 256> playing_sounds;
+// Buffers are rendered in chunks of this many render rate samples, each
+// pushed through the whole signal chain before the next, so a chunk's block
+// buffers stay in cache from one stage to the next
+constexpr unsigned long MIX_BLOCK = 1024;
 
-Envelope envelope = {.attack=0, .decay=0,.sustain=0,.release=0};
-LFO vol_lfo = {.frequency = 0, .amplitude = 0, .phase = 0 };
-LFO filter_cutoff_lfo = {.frequency = 0.001, .amplitude = 0.3, .phase = 0 };
-Filter filter {.cutoff=10, .Q=1};
+// Program changes crossfade the waveform mix over PATCH_CROSSFADE_ms instead
+// of jumping. Voice output is linear in the weights, so sliding them from the
+// old patch's to the new one's crossfades every voice at once without
+// rendering anything twice. The filter and LFOs already ramp at control rate,
+// and envelope changes only apply from each voice's next segment.
+constexpr float PATCH_CROSSFADE_ms = 10;
 
-float gain = 0.5;
-float target_gain = gain;
-float gain_step = 0;
-bool gain_changing = false;
+struct WaveFade {
+    WaveMix from = {};
+    WaveMix to = {};
+    unsigned long position = 0;  // render samples into the fade
+    unsigned long length = 0;
 
-float p_saw = 0;
-float p_sin = 0;
-float p_square = 1;
+    bool active() const {
+        return position < length;
+    }
+
+    // the mix offset samples from now, steps once per envelope block
+    WaveMix at(unsigned long offset) const {
+        if (position + offset >= length) {
+            return to;
+        }
+        float t = static_cast<float>(position + offset) / length;
+        return {.sin = from.sin + t * (to.sin - from.sin),
+                .saw = from.saw + t * (to.saw - from.saw),
+                .square = from.square + t * (to.square - from.square)};
+    }
+};
+
+// With enough voices they are split into jobs of VOICES_PER_JOB (whole 8 wide
+// SIMD groups) and rendered on the worker pool, each thread into its own mix
+// buffer. Below the threshold waking the workers costs more than it saves.
+constexpr size_t VOICES_PER_JOB = 16;
+constexpr size_t PARALLEL_VOICE_THRESHOLD = 48;
+
+// The signal chain after the voices: modulation (control points and the
+// ramps between them, written out per sample), volume LFO, filter and gain.
+// Each stage makes one pass over the chunk's block buffers, so each is a tight
+// loop of its own, and the chain is put together once per buffer from just the
+// stages the parameters need. A new stage is a State member with the Stage
+// signature plus a line in build_pipeline().
+//
+// A patch without volume LFO or with the filter bypassed skips those stages
+// entirely. The ramps of a skipped stage aren't advanced; they pick up from
+// wherever they stopped once the stage is back.
+//
+// The send effects (delay, then reverb) come after decimation, at the output
+// rate, and are stereo. With both at mix 0 the result goes straight to the
+// interleave. An effect coming back on starts from empty delay lines rather
+// than whatever it held when it went off.
+//
+// The voices are mono unless a unison stack is spread (POST_STEREO). Then they
+// render into a left and a right block buffer and every stage runs on both;
+// the right channel picks up the filter and decimator state of the mono one
+// when stereo comes on, so the switch doesn't click.
+//
+// POST_VOICE_FILTER isn't a stage but the filter moving into the voices (it
+// takes POST_FILTER's place). The voice filters start from silence whenever
+// it comes on.
+enum PostFeature {
+    POST_LFO = 1, POST_FILTER = 2, POST_DELAY = 4, POST_REVERB = 8, POST_STEREO = 16, POST_VOICE_FILTER = 32
+};
+constexpr size_t MAX_STAGES = 4;
+
+// Everything one engine owns. What used to be file scope globals, so the
+// functions below read much as they did.
+struct SynthEngine::State {
+    VoicePool voices;
+    // segment lengths for the current parameters and render rate, see update_sounds()
+    EnvelopeShape env_shape = {};
+
+    NoteInput note_inputs[NOTE_INPUTS];
+    // engine frame render() produces next
+    uint64_t engine_frame = 0;
+
+    // receive-to-render latency of remote note events, audio thread -> remote thread
+    SpscQueue<float, 1024> remote_latencies;
+
+    // GUI thread's working copy, only touched by the set_* functions
+    SynthParams pending_params = {
+            .key_freq_map = {},
+            .envelope = {.attack=0, .decay=0,.sustain=0,.release=0},
+            .vol_lfo = {.frequency = 0, .amplitude = 0},
+            .filter_cutoff_lfo = {.frequency = 0.001, .amplitude = 0.3},
+            .filter = {.cutoff=10, .Q=1, .bypass=false, .key_track=0, .velocity=0},
+            .delay = {.time = 350, .feedback = 0.4, .mix = 0},
+            .reverb = {.time = 2000, .damping = 0.3, .mix = 0},
+            .unison = {.voices = 1, .detune = 20, .spread = 0.5},
+            .p_sin = 0,
+            .p_saw = 0,
+            .p_square = 1,
+            .control_interval = DEFAULT_CONTROL_INTERVAL,
+            .max_polyphony = DEFAULT_POLYPHONY,
+            .steal_policy = STEAL_RELEASED_FIRST,
+            .oversampling = 1,
+            .sample_rate_kHz = DEFAULT_SAMPLERATE_kHz,
+            .program = 0,
+            .gain_target = DEFAULT_GAIN,
+            .gain_ramp_ms = 0,
+            .gain_change = 0
+    };
+    TripleBuffer<SynthParams> params_buffer{pending_params};
+
+    // audio thread side of change_volume()
+    float gain = DEFAULT_GAIN;
+    float target_gain = gain;
+    float gain_step = 0;
+    bool gain_changing = false;
+    uint32_t gain_change = 0;
+
+    Modulation modulation;
+
+    // Sample rate and oversampling, audio thread only. Voices, modulation and the
+    // filter all run at render_rate_kHz and the result is brought back down to
+    // output_rate_kHz by
+    // one (2x) or two (4x) half-band stages. The last stage sets the passband
+    // edge, so it gets the long filter; the first 4x stage only has to keep
+    // images out of the band the last one keeps, a short one does.
+    unsigned oversampling = 1;
+    float output_rate_kHz = DEFAULT_SAMPLERATE_kHz;
+    float render_rate_kHz = DEFAULT_SAMPLERATE_kHz;
+    // per channel, left (or mono) then right
+    HalfbandDecimator decimate_first[2] = {HalfbandDecimator(6), HalfbandDecimator(6)};
+    HalfbandDecimator decimate_last[2] = {HalfbandDecimator(12), HalfbandDecimator(12)};
+
+    // a chunk's block buffers: the voice mix (mix_buffer, and mix_right_buffer
+    // for stereo), processed in place, and the per-sample modulation the stages
+    // after it read
+    unsigned channels = 1;
+    alignas(64) float mix_buffer[MIX_BLOCK];
+    alignas(64) float mix_right_buffer[MIX_BLOCK];
+    alignas(64) float lfo_gain_buffer[MIX_BLOCK];
+    alignas(64) float master_gain_buffer[MIX_BLOCK];
+    alignas(64) float coefficient_buffer[5][MIX_BLOCK];  // b0 b1 b2 a1 a2
+    // send effects, lines sized for the highest rate up front
+    StereoDelay delay{MAX_SAMPLERATE_kHz};
+    FdnReverb reverb{MAX_SAMPLERATE_kHz};
+    alignas(64) float left_buffer[MIX_BLOCK];
+    alignas(64) float right_buffer[MIX_BLOCK];
+    WaveFade wave_fade;
+    uint32_t program = 0;
+    // envelope levels for one ENVELOPE_BLOCK, one column per pool slot
+    alignas(64) float envelope_buffer[ENVELOPE_BLOCK * MAX_VOICES] = {};
+    // Unison stacks, see update_unison(). Oscillator k of a stack plays at
+    // unison_ratio[k] times the voice frequency. With more than one oscillator
+    // per voice the envelopes are spread over unison_envelopes, a column per
+    // oscillator (rows of unison_stride), scaled by the oscillator's gain on
+    // each channel. oscillator_voice and oscillator_gain have that for every
+    // pool slot, so a row spreads in one flat loop whatever the stack size.
+    std::array<float, MAX_UNISON> unison_ratio = {1};
+    std::array<uint16_t, MAX_OSCILLATORS> oscillator_voice;
+    std::array<float, MAX_OSCILLATORS> oscillator_gain[2];
+    float unison_detune = -1;  // what the tables were worked out for, -1 before the first time
+    float unison_spread = -1;
+    size_t unison_stride = 0;
+    alignas(64) float unison_envelopes[2][ENVELOPE_BLOCK * MAX_OSCILLATORS];
+    alignas(64) float thread_mix[MAX_POOL_THREADS][MIX_BLOCK];
+    alignas(64) float thread_mix_right[MAX_POOL_THREADS][MIX_BLOCK];
+    bool thread_mix_used[MAX_POOL_THREADS] = {};
+
+    BiquadHistory filter_history[2];  // per channel
+
+    // Event recording, see set_recording(). recorded_params is the snapshot
+    // the last recorded buffer ran with, what the next one gets diffed against.
+    std::atomic<bool> recording{false};
+    bool recorder_primed = false;
+    SynthParams recorded_params = {};
+    SpscQueue<RecordedEvent, 8192> recorded_events;
 
-// filter coefficients (should be calculated based on set cutoff and Q)
-float a0 = 0.1;
-float a1 = 0.1;
-float a2 = 0.1;
-float b0 = 0.1;
-float b1 = 0.1;
-float b2 = 0.1;
+    uint64_t frame_now(NoteInput &input);
+    void push_note_event(NoteInput &input, const NoteEvent &event);
+    void publish_params();
+    float cutoff_omega(const SynthParams &params, double lfo_phase) const;
+    void control_update(const SynthParams &params);
+    short pick_victim(StealPolicy policy);
+    void steal_voice(size_t v);
+    void enforce_polyphony(const SynthParams &params);
+    void tune_voice(size_t v);
+    BiquadCoefficients voice_filter_coefficients(size_t v, float omega, const SynthParams &params) const;
+    void prime_voice_filter(size_t v, const SynthParams &params);
+    void update_voice_filters(size_t first, size_t count, unsigned long offset, unsigned long n,
+                              const SynthParams &params);
+    void update_unison(const SynthParams &params);
+    void start_sound(const NoteEvent &event, const SynthParams &params);
+    void release_sound(const NoteEvent &event);
+    void record(RecordedEventType type, uint16_t id, float value, uint64_t frame);
+    void record_params(const SynthParams &params, bool everything);
+    void apply_note_event(const NoteEvent &event, const SynthParams &params, uint64_t frame);
+    uint64_t apply_note_events(uint64_t due, const SynthParams &params);
+    void update_sounds(const SynthParams &params);
+    void spread_unison_envelopes(unsigned long frames, size_t first, size_t count);
+    void render_voice_range(float *mix, float *mix_right, unsigned long frames, size_t first, size_t count,
+                            unsigned waves, const WaveFade &fade, const SynthParams &params);
+    struct VoiceJobs;
+    static void render_voice_job(void *context, unsigned job, unsigned thread);
+    void render_voices(float *mix, float *mix_right, unsigned long frames, const SynthParams &params);
+    using Stage = void (State::*)(unsigned long samples, const SynthParams &params);
+    Stage pipeline[MAX_STAGES] = {};
+    size_t pipeline_length = 0;
+    unsigned features = 0;
+    float *channel_mix(unsigned c) {
+        return c == 0 ? mix_buffer : mix_right_buffer;
+    }
+    void build_pipeline(const SynthParams &params);
+    void stage_modulation(unsigned long samples, const SynthParams &params);
+    void stage_vol_lfo(unsigned long samples, const SynthParams &params);
+    void stage_filter(unsigned long samples, const SynthParams &params);
+    void stage_gain(unsigned long samples, const SynthParams &params);
+    void write_output(const float *left, const float *right, float *out, unsigned long frames);
+    void apply_render_rate(float rate_kHz, unsigned factor);
+    const float *decimate(unsigned c, unsigned long samples);
+    void render_audio(float *out, unsigned long framesPerBuffer);
+};
 
-void note_on(unsigned short key, unsigned short velocity) {
-    //spdlog::debug("note on key:{} vel:{:.2f}", note.key, note.velocity);
-    if (key >= 0 && key < 256) {
-        note_on_buffer.push_back({.key=key, .velocity=velocity});
-        //spdlog::debug("+ {}", note_buffer_to_string(note_on_buffer));
-        //spdlog::debug("- {}", note_buffer_to_string(note_off_buffer));
+// frame for an event played right now, 0 (as soon as possible) with no clock.
+// Only input's producer thread may call this
+uint64_t SynthEngine::State::frame_now(NoteInput &input) {
+    const FrameClock &clock = input.clock.read();
+    if (!clock.valid) {
+        return 0;
     }
+    double elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - clock.time).count();
+    double lead = std::clamp(elapsed_ms * clock.rate_kHz, 0.0, double(clock.buffer_frames * MAX_EVENT_LEAD_BUFFERS));
+    return clock.frame + clock.buffer_frames + static_cast<uint64_t>(lead);
 }
 
-void note_off(unsigned short key) {
-    //spdlog::debug("note off key:{}", note.key, note.velocity);
-    if (key >= 0 && key < 256) {
-        note_off_buffer.push_back(key);
-        //spdlog::debug("+ {}", note_buffer_to_string(note_on_buffer));
-        //spdlog::debug("- {}", note_buffer_to_string(note_off_buffer));
+void SynthEngine::State::push_note_event(NoteInput &input, const NoteEvent &event) {
+    //spdlog::debug("note {} key:{} vel:{}", event.type == NOTE_ON ? "on" : "off", event.key, event.velocity);
+    if (event.key < 256) {
+        if (!input.queue.push(event)) {
+            spdlog::warn("note event queue full, dropped note {} {}", event.type == NOTE_ON ? "on" : "off", event.key);
+        }
     }
 }
 
-void update_filter_coefficients() {
-    float omega = 2.0 * M_PI * filter.cutoff / SAMPLERATE_kHz;  // Angular frequency
-    omega += filter_cutoff_lfo.amplitude * static_cast<float>(std::sin(filter_cutoff_lfo.phase)) * omega;
+SynthEngine::SynthEngine() : state(std::make_unique<State>()) {}
 
-    float alpha = std::sin(omega) / (2.0 * filter.Q);  // Bandwidth
-    // Calculate the coefficients
-    b0 = (1 - std::cos(omega)) / 2.0;
-    b1 = 1 - std::cos(omega);
-    b2 = (1 - std::cos(omega)) / 2.0;
-    a0 = 1 + alpha;
-    a1 = -2 * std::cos(omega);
-    a2 = 1 - alpha;
+SynthEngine::~SynthEngine() = default;
 
-    // Normalize the coefficients
-    b0 /= a0;
-    b1 /= a0;
-    b2 /= a0;
-    a1 /= a0;
-    a2 /= a0;
-    a0 = 1.0;
+void SynthEngine::note_on(unsigned short key, unsigned short velocity) {
+    note_on_at(key, velocity, state->frame_now(state->note_inputs[INPUT_GUI]));
+}
 
-    //spdlog::debug("{:.2f} {:.2f} {:.2f} {:.2f} {:.2f} {:.2f} ", a0, a1, a2, b0, b1, b2);
+void SynthEngine::note_off(unsigned short key) {
+    note_off_at(key, state->frame_now(state->note_inputs[INPUT_GUI]));
 }
 
-void update_volume() {
-    if (gain_changing) {
-        float new_vol = gain + gain_step;
+void SynthEngine::note_on_at(unsigned short key, unsigned short velocity, uint64_t frame) {
+    state->push_note_event(state->note_inputs[INPUT_GUI], {.type=NOTE_ON, .key=key, .velocity=velocity, .frame=frame});
+}
+
+void SynthEngine::note_off_at(unsigned short key, uint64_t frame) {
+    state->push_note_event(state->note_inputs[INPUT_GUI], {.type=NOTE_OFF, .key=key, .velocity=0, .frame=frame});
+}
+
+void SynthEngine::remote_note_on(unsigned short key, unsigned short velocity, std::chrono::steady_clock::time_point received) {
+    NoteInput &input = state->note_inputs[INPUT_REMOTE];
+    state->push_note_event(input, {.type=NOTE_ON, .key=key, .velocity=velocity, .frame=state->frame_now(input), .received=received});
+}
+
+void SynthEngine::remote_note_off(unsigned short key, std::chrono::steady_clock::time_point received) {
+    NoteInput &input = state->note_inputs[INPUT_REMOTE];
+    state->push_note_event(input, {.type=NOTE_OFF, .key=key, .velocity=0, .frame=state->frame_now(input), .received=received});
+}
+
+bool SynthEngine::pop_remote_note_latency(float &ms) {
+    return state->remote_latencies.pop(ms);
+}
 
+void SynthEngine::sync_frame_clock(unsigned long framesPerBuffer) {
+    auto now = std::chrono::steady_clock::now();
+    for (NoteInput &input : state->note_inputs) {
+        FrameClock &clock = input.clock.write_buffer();
+        clock.valid = true;
+        clock.time = now;
+        clock.frame = state->engine_frame;
+        clock.buffer_frames = framesPerBuffer;
+        clock.rate_kHz = state->output_rate_kHz;
+        input.clock.publish();
+    }
+}
+
+uint64_t SynthEngine::get_engine_frame() const {
+    return state->engine_frame;
+}
+
+void SynthEngine::set_recording(bool on) {
+    state->recording.store(on, std::memory_order_release);
+}
+
+bool SynthEngine::pop_recorded_event(RecordedEvent &event) {
+    return state->recorded_events.pop(event);
+}
+
+unsigned long long SynthEngine::get_recorded_event_overflows() const {
+    return state->recorded_events.overflow_count();
+}
+
+unsigned long long SynthEngine::get_note_event_overflows() const {
+    unsigned long long overflows = 0;
+    for (const NoteInput &input : state->note_inputs) {
+        overflows += input.queue.overflow_count();
+    }
+    return overflows;
+}
+
+// filter cutoff in radians per sample with the cutoff LFO at lfo_phase
+float SynthEngine::State::cutoff_omega(const SynthParams &params, double lfo_phase) const {
+    float omega = 2.0 * M_PI * params.filter.cutoff / render_rate_kHz;  // Angular frequency
+    omega += params.filter_cutoff_lfo.amplitude * static_cast<float>(std::sin(lfo_phase)) * omega;
+    return omega;
+}
+
+// Advance the LFOs and the master gain to the end of the next control
+// interval and point every ramp at the values there
+void SynthEngine::State::control_update(const SynthParams &params) {
+    // n is in render rate samples, the interval itself in output samples
+    const unsigned n = params.control_interval * oversampling;
+    Modulation &m = modulation;
+
+    m.vol_lfo_phase = std::fmod(m.vol_lfo_phase + n * 2.0 * M_PI * params.vol_lfo.frequency / render_rate_kHz, 2.0 * M_PI);
+    m.filter_cutoff_lfo_phase = std::fmod(m.filter_cutoff_lfo_phase + n * 2.0 * M_PI * params.filter_cutoff_lfo.frequency / render_rate_kHz, 2.0 * M_PI);
+
+    float lfo_gain = 1 + params.vol_lfo.amplitude * static_cast<float>(std::sin(m.vol_lfo_phase));
+
+    BiquadCoefficients c = lowpass_coefficients(cutoff_omega(params, m.filter_cutoff_lfo_phase), params.filter.Q);
+
+    // gain_step is per output sample, take a control interval's worth at once
+    if (gain_changing) {
+        float new_vol = gain + gain_step * params.control_interval;
         if ((gain_step > 0 && new_vol >= target_gain) || (gain_step < 0 && new_vol <= target_gain)) {
             gain = target_gain;
             gain_changing = false;
-            //spdlog::debug("gain == target gain");
         } else {
             gain = new_vol;
         }
     }
+
+    if (m.primed) {
+        m.lfo_gain.set_target(lfo_gain, n);
+        m.master_gain.set_target(gain, n);
+        m.b0.set_target(c.b0, n);
+        m.b1.set_target(c.b1, n);
+        m.b2.set_target(c.b2, n);
+        m.a1.set_target(c.a1, n);
+        m.a2.set_target(c.a2, n);
+    } else {
+        m.lfo_gain.jump(lfo_gain);
+        m.master_gain.jump(gain);
+        m.b0.jump(c.b0);
+        m.b1.jump(c.b1);
+        m.b2.jump(c.b2);
+        m.a1.jump(c.a1);
+        m.a2.jump(c.a2);
+        m.primed = true;
+    }
+    m.countdown = n;
 }
 
-// function updates sounds, get called at top of buffer
-void update_sounds() {
-    unsigned short on_buffer_size = note_on_buffer.size();
-    unsigned short off_buffer_size = note_off_buffer.size();
-
-    for (unsigned short i = 0; i < on_buffer_size; ++i) {
-        // Check if sound is active
-        if (!playing_sounds[note_on_buffer[i].key].has_value()) {
-            // Sound is not active, start sound
-            float max_vol = note_on_buffer[i].velocity / 255.0f;
-            playing_sounds[note_on_buffer[i].key] = {
-                    .note_on = true, // key is pressed (distinct from sound is playing)
-                    .stage = ATTACK, // attack phase
-                    .frequency = key_freq_map[note_on_buffer[i].key], // look up frequency
-                    .vol = 0,   // current/starting volume
-                    .phase = 0, // current phase
-                    .max_vol = max_vol, // peak volume for this sound
-                    .vol_step = max_vol / (SAMPLERATE_kHz * envelope.attack) // amount to increase per sample
-            };
-            //spdlog::debug("enter ATTACK, vol_step {} ", sound.vol_step);
-        } else if (!playing_sounds[note_on_buffer[i].key].value().note_on) {
-            // Sound is active, but key is not pressed. Restart sound
-            // without doing a step function on the volume or phase
-            Sound& sound = *playing_sounds[note_on_buffer[i].key];
-            float max_vol = note_on_buffer[i].velocity / 255.0f;
-            // leave phase and volume alone
-            sound.note_on = true;
-            sound.stage = ATTACK;
-            sound.frequency = key_freq_map[note_on_buffer[i].key];
-            sound.max_vol = max_vol;
-            sound.vol_step = max_vol / (SAMPLERATE_kHz * envelope.attack);
-        }
-    }
-
-    for (unsigned short i = 0; i < off_buffer_size; ++i) {
-        // set note on to false,
-        // leave volume and phase, frequency, max_vol
-        // enter release phase
-        if (playing_sounds[note_off_buffer[i]].has_value()) {
-            Sound &sound = *playing_sounds[note_off_buffer[i]];
-            sound.note_on = false;
-            sound.stage = RELEASE;
-            sound.vol_step = -(sound.max_vol * envelope.sustain) / (SAMPLERATE_kHz * envelope.release);
-            spdlog::debug("enter RELEASE, vol_step {}", sound.vol_step);
+// Pick the voice to steal under policy, only looking at voices that still
+// count against the cap. Returns NO_VOICE if there are none.
+short SynthEngine::State::pick_victim(StealPolicy policy) {
+    short victim = NO_VOICE;
+    uint32_t victim_age = 0;
+    float victim_vol = 0;
+    bool victim_released = false;
+    for (size_t j = 0; j < voices.count; ++j) {
+        if (voices.stage[j] == STOLEN) {
+            continue;
+        }
+        uint32_t age = voices.next_start - voices.started[j];  // wrap safe
+        // a voice in attack is judged by where it is heading, or the note
+        // that just started would always be the quietest
+        float vol = voices.stage[j] == ATTACK ? voices.max_vol[j] : voices.vol[j];
+        bool released = !voices.note_on[j];
+        bool better;
+        if (victim == NO_VOICE) {
+            better = true;
+        } else if (policy == STEAL_OLDEST) {
+            better = age > victim_age;
+        } else if (policy == STEAL_QUIETEST) {
+            better = vol < victim_vol;
+        } else if (released != victim_released) {
+            better = released;
         } else {
-            spdlog::debug("note in off_buffer had no value");
-        }
-    }
-
-    // state transitions
-    std::vector<size_t> toRemove;
-    for (size_t j = 0; j < playing_sounds.size(); ++j) {  // Changed the loop to use index
-        auto& opt_sound = playing_sounds[j];
-        if (!opt_sound.has_value()) continue;
-        Sound& sound = opt_sound.value();
-        if (!sound.note_on) {
-            sound.stage = RELEASE;
-            sound.vol_step = -(sound.max_vol*envelope.sustain)
-                             /(SAMPLERATE_kHz * envelope.release);
-            //spdlog::debug("enter RELEASE, vol_step {} ", sound.vol_step);
-        }
-        switch(sound.stage){
-            case ATTACK:
-                if (sound.vol >= sound.max_vol) {
-                    sound.stage = DECAY;
-                    sound.vol_step = -sound.max_vol*(1-(envelope.sustain))
-                                     /(SAMPLERATE_kHz * envelope.decay);
-                    //spdlog::debug("enter DECAY, vol_step {} ", sound.vol_step);
-                }
-                break;
-            case DECAY:
-                if (sound.vol <= sound.max_vol*envelope.sustain) {
-                    sound.stage = SUSTAIN;
-                    sound.vol_step = 0;
-                    spdlog::debug("enter SUSTAIN, vol_step {} ", sound.vol_step);
-                }
-                break;
-            case SUSTAIN:
+            better = released ? vol < victim_vol : age > victim_age;
+        }
+        if (better) {
+            victim = static_cast<short>(j);
+            victim_age = age;
+            victim_vol = vol;
+            victim_released = released;
+        }
+    }
+    return victim;
+}
 
-                break;
-            case RELEASE:
-                if (sound.vol <= 0) {
-                    toRemove.push_back(j);  // Add this line to mark for removal
-                    //spdlog::debug("note over");
+// Start a short fade on voice v and give its key back
+void SynthEngine::State::steal_voice(size_t v) {
+    voices.detach(v);
+    voices.note_on[v] = false;
+    envelope_enter(voices, v, STOLEN, env_shape);
+}
+
+// Make room for one more voice under the cap, called before voices.add()
+void SynthEngine::State::enforce_polyphony(const SynthParams &params) {
+    size_t fading = 0;
+    for (size_t j = 0; j < voices.count; ++j) {
+        fading += voices.stage[j] == STOLEN;
+    }
+    if (voices.count - fading >= params.max_polyphony) {
+        short victim = pick_victim(params.steal_policy);
+        if (victim != NO_VOICE) {
+            steal_voice(victim);
+            ++fading;
+        }
+    }
+    // too many fades (or no room at all), cut the quietest fade short
+    while (voices.count > 0 && (fading > MAX_STEAL_FADES || voices.count >= MAX_VOICES)) {
+        short quietest = NO_VOICE;
+        for (size_t j = 0; j < voices.count; ++j) {
+            if (voices.stage[j] == STOLEN && (quietest == NO_VOICE || voices.vol[j] < voices.vol[quietest])) {
+                quietest = static_cast<short>(j);
+            }
+        }
+        if (quietest == NO_VOICE) {
+            break;
+        }
+        voices.remove(quietest);
+        --fading;
+    }
+}
+
+// phase increments of voice v's stack for its frequency
+void SynthEngine::State::tune_voice(size_t v) {
+    const size_t unison = voices.unison;
+    for (size_t k = 0; k < unison; ++k) {
+        voices.phase_inc[v * unison + k] = phase_increment(voices.frequency[v] * unison_ratio[k], render_rate_kHz);
+    }
+}
+
+// Voice v's filter for a cutoff of omega (LFO included), moved by its key and velocity
+BiquadCoefficients SynthEngine::State::voice_filter_coefficients(size_t v, float omega,
+                                                                 const SynthParams &params) const {
+    // a key mapped to 0 Hz would take the log to -inf
+    float key_octaves = std::log2(std::max(voices.frequency[v], 1e-6f) / KEY_TRACK_CENTRE_kHz);
+    float octaves = params.filter.key_track * key_octaves
+                    + params.filter.velocity * VELOCITY_OCTAVES * (voices.max_vol[v] - 1);
+    return lowpass_coefficients(omega * std::exp2(octaves), params.filter.Q);
+}
+
+// Put voice v's filter lanes straight on its coefficients for right now, no ramp
+void SynthEngine::State::prime_voice_filter(size_t v, const SynthParams &params) {
+    BiquadCoefficients c = voice_filter_coefficients(v, cutoff_omega(params, modulation.voice_filter_lfo_phase), params);
+    const float value[BIQUAD_COEFFICIENTS] = {c.b0, c.b1, c.b2, c.a1, c.a2};
+    const size_t unison = voices.unison;
+    for (size_t k = 0; k < BIQUAD_COEFFICIENTS; ++k) {
+        std::fill_n(voices.filter_coefficient[k].begin() + v * unison, unison, value[k]);
+        std::fill_n(voices.filter_step[k].begin() + v * unison, unison, 0.0f);
+    }
+}
+
+// Ramp the filter lanes of voices [first, first + count) over the next n
+// samples to their coefficients offset + n samples into the voices being
+// rendered. This is the voice filters' control rate: once per envelope block
+// (or less, where note events cut blocks short), not the control interval,
+// since it runs with the voices rather than after them. Every oscillator of a
+// stack gets the same ramp, so they stay on the same coefficients.
+void SynthEngine::State::update_voice_filters(size_t first, size_t count, unsigned long offset, unsigned long n,
+                                              const SynthParams &params) {
+    const double lfo_step = 2.0 * M_PI * params.filter_cutoff_lfo.frequency / render_rate_kHz;
+    const float omega = cutoff_omega(params, modulation.voice_filter_lfo_phase + (offset + n) * lfo_step);
+    const size_t unison = voices.unison;
+    for (size_t v = first; v < first + count; ++v) {
+        BiquadCoefficients c = voice_filter_coefficients(v, omega, params);
+        const float target[BIQUAD_COEFFICIENTS] = {c.b0, c.b1, c.b2, c.a1, c.a2};
+        for (size_t k = 0; k < BIQUAD_COEFFICIENTS; ++k) {
+            float step = (target[k] - voices.filter_coefficient[k][v * unison]) / n;
+            std::fill_n(voices.filter_step[k].begin() + v * unison, unison, step);
+        }
+    }
+}
+
+// Rework the unison tables when the stack parameters change, and restack and
+// retune the running voices. Oscillators are detuned evenly across
+// +-detune cents and panned evenly across +-spread, taking pan slots from both
+// ends inwards so neighbouring pitches land on opposite sides. Equal power
+// panning, scaled so a centred oscillator gets 1 on each side, and
+// 1/sqrt(unison) overall so a stack of unrelated phases comes out about as
+// loud as one oscillator.
+void SynthEngine::State::update_unison(const SynthParams &params) {
+    const size_t unison = unison_count(params);
+    if (unison == voices.unison && params.unison.detune == unison_detune && params.unison.spread == unison_spread) {
+        return;
+    }
+    unison_detune = params.unison.detune;
+    unison_spread = params.unison.spread;
+    const bool stereo = unison_stereo(params);
+    const float norm = 1 / std::sqrt(static_cast<float>(unison));
+    std::array<float, MAX_UNISON> gain[2];
+    for (size_t k = 0; k < unison; ++k) {
+        // -1..1 across the stack
+        float position = unison == 1 ? 0 : 2.0f * k / (unison - 1) - 1;
+        unison_ratio[k] = unison == 1 ? 1 : std::exp2(unison_detune * position / 1200);
+        size_t slot = k % 2 == 0 ? k / 2 : unison - 1 - k / 2;
+        float pan = unison == 1 ? 0 : unison_spread * (2.0f * slot / (unison - 1) - 1);
+        float angle = static_cast<float>(M_PI / 4) * (1 + pan);
+        gain[0][k] = stereo ? norm * static_cast<float>(M_SQRT2) * std::cos(angle) : norm;
+        gain[1][k] = stereo ? norm * static_cast<float>(M_SQRT2) * std::sin(angle) : norm;
+    }
+    for (size_t o = 0; o < MAX_OSCILLATORS; ++o) {
+        oscillator_voice[o] = static_cast<uint16_t>(o / unison);
+        oscillator_gain[0][o] = gain[0][o % unison];
+        oscillator_gain[1][o] = gain[1][o % unison];
+    }
+
+    if (unison != voices.unison) {
+        // Voices keep the oscillators both stack sizes have, extra ones start
+        // fresh. Growing stacks move up, so walk down from the top; shrinking
+        // ones move down, walk up. Either way a stack only ever lands on slots
+        // already read.
+        const size_t old = voices.unison;
+        const size_t kept = std::min(old, unison);
+        auto restack = [&](size_t v) {
+            std::array<uint32_t, MAX_UNISON> phases;
+            std::copy_n(voices.phase.begin() + v * old, kept, phases.begin());
+            for (size_t k = 0; k < unison; ++k) {
+                voices.phase[v * unison + k] = k < kept ? phases[k] : unison_phase(voices.started[v], k);
+            }
+            voices.restack_filters(v, old, unison);
+        };
+        if (unison > old) {
+            for (size_t v = voices.count; v-- > 0;) {
+                restack(v);
+            }
+        } else {
+            for (size_t v = 0; v < voices.count; ++v) {
+                restack(v);
+            }
+            // the slots the stacks moved out of go back to silent lanes
+            voices.clear_filters(voices.count * unison, voices.count * (old - unison));
+        }
+        voices.unison = unison;
+    }
+    for (size_t v = 0; v < voices.count; ++v) {
+        tune_voice(v);
+    }
+}
+
+void SynthEngine::State::start_sound(const NoteEvent &event, const SynthParams &params) {
+    float max_vol = event.velocity / 255.0f;
+    short v = voices.find(event.key);
+    // Check if sound is active
+    if (v == NO_VOICE) {
+        // Sound is not active, start sound
+        enforce_polyphony(params);
+        size_t n = voices.add(event.key);
+        voices.note_on[n] = true;
+        voices.frequency[n] = params.key_freq_map[event.key]; // look up frequency
+        tune_voice(n);
+        voices.vol[n] = 0;   // current/starting volume
+        for (size_t k = 0; k < voices.unison; ++k) {
+            voices.phase[n * voices.unison + k] = unison_phase(voices.started[n], k); // current phase
+        }
+        voices.max_vol[n] = max_vol; // peak volume for this sound
+        prime_voice_filter(n, params);  // its lanes are silent already
+        envelope_enter(voices, n, ATTACK, env_shape);
+    } else if (!voices.note_on[v]) {
+        // Sound is active, but key is not pressed. Restart sound
+        // without doing a step function on the volume or phase
+        voices.note_on[v] = true;
+        voices.frequency[v] = params.key_freq_map[event.key];
+        tune_voice(v);
+        voices.max_vol[v] = max_vol;
+        envelope_enter(voices, v, ATTACK, env_shape);
+    }
+}
+
+void SynthEngine::State::release_sound(const NoteEvent &event) {
+    // set note on to false,
+    // leave volume and phase, frequency, max_vol
+    // enter release phase
+    short v = voices.find(event.key);
+    if (v != NO_VOICE) {
+        voices.note_on[v] = false;
+        envelope_enter(voices, v, RELEASE, env_shape);
+    }
+}
+
+void SynthEngine::State::record(RecordedEventType type, uint16_t id, float value, uint64_t frame) {
+    recorded_events.push({.frame = frame, .type = type, .part = 0, .id = id, .value = value});
+}
+
+// Log whatever in params differs from the last recorded buffer (or all of it
+// when a recording starts), stamped with the frame the buffer starts at
+void SynthEngine::State::record_params(const SynthParams &params, bool everything) {
+    const SynthParams &last = recorded_params;
+    if (everything || params.sample_rate_kHz != last.sample_rate_kHz) {
+        record(REC_SAMPLE_RATE, 0, params.sample_rate_kHz, engine_frame);
+    }
+    if (everything || params.oversampling != last.oversampling) {
+        record(REC_OVERSAMPLING, 0, static_cast<float>(params.oversampling), engine_frame);
+    }
+    if (everything || params.control_interval != last.control_interval) {
+        record(REC_CONTROL_INTERVAL, 0, static_cast<float>(params.control_interval), engine_frame);
+    }
+    if (everything || params.max_polyphony != last.max_polyphony || params.steal_policy != last.steal_policy) {
+        record(REC_POLYPHONY, params.steal_policy, static_cast<float>(params.max_polyphony), engine_frame);
+    }
+    for (uint16_t key = 0; key < params.key_freq_map.size(); ++key) {
+        if (everything || params.key_freq_map[key] != last.key_freq_map[key]) {
+            record(REC_KEY_FREQ, key, params.key_freq_map[key], engine_frame);
+        }
+    }
+    for (uint16_t id = 0; id < PARAM_COUNT; ++id) {
+        float value = read_param(params, static_cast<ParamId>(id));
+        if (everything || value != read_param(last, static_cast<ParamId>(id))) {
+            record(REC_PARAM, id, value, engine_frame);
+        }
+    }
+    if (!everything && params.program != last.program) {
+        record(REC_PROGRAM, 0, 0, engine_frame);
+    }
+    recorded_params = params;
+}
+
+// frame is where the event actually takes effect, its own or later if it came late
+void SynthEngine::State::apply_note_event(const NoteEvent &event, const SynthParams &params, uint64_t frame) {
+    if (event.type == NOTE_ON) {
+        start_sound(event, params);
+    } else {
+        release_sound(event);
+    }
+    if (recording.load(std::memory_order_relaxed)) {
+        record(event.type == NOTE_ON ? REC_NOTE_ON : REC_NOTE_OFF, event.key,
+               static_cast<float>(event.velocity), frame);
+    }
+    if (event.received.time_since_epoch().count() != 0) {
+        std::chrono::duration<float, std::milli> latency = std::chrono::steady_clock::now() - event.received;
+        remote_latencies.push(latency.count());
+    }
+}
+
+// Apply every queued event due at or before frame due (late ones included)
+// and return the frame of the next one, or NO_EVENT. Events from one input are
+// applied in the order they were played, so a quick release/re-press of the
+// same key ends up held. At most one queue's worth per input per call so a
+// flood can't stall us, the rest waits for the next block.
+uint64_t SynthEngine::State::apply_note_events(uint64_t due, const SynthParams &params) {
+    uint64_t next = NO_EVENT;
+    for (NoteInput &input : note_inputs) {
+        for (size_t n = 0; n < input.queue.capacity(); ++n) {
+            if (!input.has_held) {
+                if (!input.queue.pop(input.held)) {
+                    break;
                 }
+                input.has_held = true;
+            }
+            if (input.held.frame > due) {
+                next = std::min(next, input.held.frame);
                 break;
+            }
+            apply_note_event(input.held, params, due);
+            input.has_held = false;
+        }
+    }
+    return next;
+}
+
+// function updates sounds, get called at top of buffer. Stage changes happen
+// in render_envelopes() on their exact sample, all that's left here is
+// dropping voices whose release (or steal fade) has finished.
+void SynthEngine::State::update_sounds(const SynthParams &params) {
+    const Envelope &e = params.envelope;
+    env_shape = envelope_shape(e.attack, e.decay, e.sustain, e.release, STEAL_FADE_ms, render_rate_kHz);
+
+    apply_note_events(engine_frame, params);
+
+    // walked backwards so remove() only ever moves an already visited voice
+    // into the current slot
+    for (size_t j = voices.count; j-- > 0;) {
+        bool ending = voices.stage[j] == RELEASE || voices.stage[j] == STOLEN;
+        if (ending && voices.env_remaining[j] == ENVELOPE_HOLD) {
+            voices.remove(j);
+        }
+    }
+}
+
+// Copy voices [first, first + count)'s envelope rows out to their unison
+// stacks, each oscillator's column scaled by its gain on each channel
+void SynthEngine::State::spread_unison_envelopes(unsigned long frames, size_t first, size_t count) {
+    const size_t begin = first * voices.unison;
+    const size_t end = (first + count) * voices.unison;
+    const uint16_t *voice = oscillator_voice.data();
+    for (unsigned c = 0; c < channels; ++c) {
+        const float *gain = oscillator_gain[c].data();
+        for (unsigned long i = 0; i < frames; ++i) {
+            const float *row = envelope_buffer + i * MAX_VOICES;
+            float *out = unison_envelopes[c] + i * unison_stride;
+            for (size_t o = begin; o < end; ++o) {
+                out[o] = row[voice[o]] * gain[o];
+            }
+        }
+    }
+}
+
+// Render voices [first, first + count) into mix[0, frames) (and mix_right with
+// stereo) an envelope block at a time. Ranges on different threads use
+// different columns of the envelope buffers and different filter lanes.
+// waves picks the kernel, OSC_FILTERED included.
+void SynthEngine::State::render_voice_range(float *mix, float *mix_right, unsigned long frames, size_t first,
+                                            size_t count, unsigned waves, const WaveFade &fade,
+                                            const SynthParams &params) {
+    float *env = envelope_buffer + first;
+    const size_t unison = voices.unison;
+    OscVoices osc = {
+            .phase = voices.phase.data() + first * unison,
+            .phase_inc = voices.phase_inc.data() + first * unison,
+            .env = env,
+            .env_stride = MAX_VOICES,
+            .count = count
+    };
+    if (unison > 1) {
+        // the kernels see every oscillator of the stacks as a voice of its own
+        osc.env = unison_envelopes[0] + first * unison;
+        osc.env_right = unison_envelopes[1] + first * unison;
+        osc.env_stride = unison_stride;
+        osc.count = count * unison;
+    }
+    if (waves & OSC_FILTERED) {
+        osc.filter = voices.filter_lanes(first * unison);
+    }
+    for (unsigned long i = 0; i < frames; i += ENVELOPE_BLOCK) {
+        unsigned long n = std::min(ENVELOPE_BLOCK, frames - i);
+        render_envelopes(voices, first, count, n, env_shape, env, MAX_VOICES);
+        if (unison > 1) {
+            spread_unison_envelopes(n, first, count);
+        }
+        if (waves & OSC_FILTERED) {
+            update_voice_filters(first, count, i, n, params);
+        }
+        if (mix_right != nullptr) {
+            stereo_oscillator_kernels[waves](mix + i, mix_right + i, n, osc, fade.at(i));
+        } else {
+            oscillator_kernels[waves](mix + i, n, osc, fade.at(i));
         }
     }
+}
+
+struct SynthEngine::State::VoiceJobs {
+    State *engine;
+    const SynthParams *params;
+    unsigned waves;
+    WaveFade fade;
+    unsigned long frames;
+    size_t count;
+    bool stereo;
+};
 
-    // Remove the frequencies that were processed
-    note_on_buffer.erase(note_on_buffer.begin(), note_on_buffer.begin() + on_buffer_size);
-    note_off_buffer.erase(note_off_buffer.begin(), note_off_buffer.begin() + off_buffer_size);
-    for (auto index : toRemove) {
-        playing_sounds[index] = std::nullopt;
+void SynthEngine::State::render_voice_job(void *context, unsigned job, unsigned thread) {
+    const VoiceJobs &jobs = *static_cast<const VoiceJobs *>(context);
+    State &e = *jobs.engine;
+    size_t first = job * VOICES_PER_JOB;
+    float *mix = e.thread_mix[thread];
+    float *mix_right = jobs.stereo ? e.thread_mix_right[thread] : nullptr;
+    if (!e.thread_mix_used[thread]) {
+        std::fill(mix, mix + jobs.frames, 0.0f);
+        if (mix_right != nullptr) {
+            std::fill(mix_right, mix_right + jobs.frames, 0.0f);
+        }
+        e.thread_mix_used[thread] = true;
     }
+    e.render_voice_range(mix, mix_right, jobs.frames, first, std::min(VOICES_PER_JOB, jobs.count - first),
+                         jobs.waves, jobs.fade, *jobs.params);
 }
 
-// Initialize variables to keep track of previous inputs and outputs
-static float last_input = 0.0f;
-static float last_input2 = 0.0f;
-static float last_output = 0.0f;
-static float last_output2 = 0.0f;
+// Render every active voice into mix[0, frames), or with a stereo chain its
+// left channel into mix and its right into mix_right
+void SynthEngine::State::render_voices(float *mix, float *mix_right, unsigned long frames, const SynthParams &params) {
+    std::fill(mix, mix + frames, 0.0f);
+    if (mix_right != nullptr) {
+        std::fill(mix_right, mix_right + frames, 0.0f);
+    }
+    wave_fade.to = {.sin = params.p_sin, .saw = params.p_saw, .square = params.p_square};
+    // only the waveforms that are actually in the mix (or fading out of it) get evaluated
+    unsigned waves = wave_mask(wave_fade.to) | (wave_fade.active() ? wave_mask(wave_fade.from) : 0);
+    if (features & POST_VOICE_FILTER) {
+        waves |= OSC_FILTERED;
+    }
+    const WaveFade fade = wave_fade;
+    wave_fade.position = std::min(wave_fade.position + frames, wave_fade.length);
+    // whole 8 lane groups, the kernels read that far
+    unison_stride = (voices.count * voices.unison + 7) & ~size_t(7);
 
+    // inside a worker job (a Mixer part) the pool is busy with the parts
+    // already. The threshold counts oscillators, but a job is VOICES_PER_JOB
+    // whole stacks (which keeps every job on whole lane groups), so it takes
+    // more voices than that to split at all.
+    const size_t oscillators = voices.count * voices.unison;
+    if (worker_count() == 0 || in_parallel_job() || oscillators < PARALLEL_VOICE_THRESHOLD
+        || voices.count <= VOICES_PER_JOB) {
+        render_voice_range(mix, mix_right, frames, 0, voices.count, waves, fade, params);
+    } else {
+        VoiceJobs jobs = {.engine = this, .params = &params, .waves = waves, .fade = fade, .frames = frames,
+                          .count = voices.count, .stereo = mix_right != nullptr};
+        std::fill(std::begin(thread_mix_used), std::end(thread_mix_used), false);
+        run_parallel(render_voice_job, &jobs, static_cast<unsigned>((voices.count + VOICES_PER_JOB - 1) / VOICES_PER_JOB));
+        for (unsigned t = 0; t < MAX_POOL_THREADS; ++t) {
+            if (thread_mix_used[t]) {
+                for (unsigned long i = 0; i < frames; ++i) {
+                    mix[i] += thread_mix[t][i];
+                }
+                if (mix_right != nullptr) {
+                    for (unsigned long i = 0; i < frames; ++i) {
+                        mix_right[i] += thread_mix_right[t][i];
+                    }
+                }
+            }
+        }
+    }
+    if (waves & OSC_FILTERED) {
+        // the voice filters' cutoff LFO moves on with the voices
+        Modulation &m = modulation;
+        double lfo_step = 2.0 * M_PI * params.filter_cutoff_lfo.frequency / render_rate_kHz;
+        m.voice_filter_lfo_phase = std::fmod(m.voice_filter_lfo_phase + frames * lfo_step, 2.0 * M_PI);
+    }
+}
 
-int audioCallback(const void *inputBuffer, void *outputBuffer,
-                  unsigned long framesPerBuffer,
-                  const PaStreamCallbackTimeInfo *timeInfo,
-                  PaStreamCallbackFlags statusFlags,
-                  void *userData) {
+static unsigned post_features(const SynthParams &params) {
+    unsigned filter = params.filter.bypass ? 0 : voice_filter(params) ? POST_VOICE_FILTER : POST_FILTER;
+    return (params.vol_lfo.amplitude != 0 ? POST_LFO : 0) | filter
+           | (params.delay.mix != 0 ? POST_DELAY : 0) | (params.reverb.mix != 0 ? POST_REVERB : 0)
+           | (unison_stereo(params) ? POST_STEREO : 0);
+}
 
-    double lfo_phase_increment = 2.0 * M_PI * vol_lfo.frequency / SAMPLERATE_kHz;
-    double filter_cutoff_lfo_phase_increment = 2.0 * M_PI * filter_cutoff_lfo.frequency / SAMPLERATE_kHz;
+void SynthEngine::State::build_pipeline(const SynthParams &params) {
+    unsigned switched_on = post_features(params) & ~features;
+    features = post_features(params);
+    if (switched_on & POST_DELAY) {
+        delay.reset();
+    }
+    if (switched_on & POST_REVERB) {
+        reverb.reset();
+    }
+    if (switched_on & POST_STEREO) {
+        // until now both channels were the mono one
+        filter_history[1] = filter_history[0];
+        decimate_first[1] = decimate_first[0];
+        decimate_last[1] = decimate_last[0];
+    }
+    if (switched_on & POST_VOICE_FILTER) {
+        // the cutoff LFO carries on from the mix filter's
+        modulation.voice_filter_lfo_phase = modulation.filter_cutoff_lfo_phase;
+        voices.clear_filters(0, voices.count * voices.unison);
+        for (size_t v = 0; v < voices.count; ++v) {
+            prime_voice_filter(v, params);
+        }
+    }
+    channels = features & POST_STEREO ? 2 : 1;
+    if (features & POST_DELAY) {
+        delay.set(params.delay.time, params.delay.feedback, params.delay.mix, output_rate_kHz);
+    }
+    if (features & POST_REVERB) {
+        reverb.set(params.reverb.time, params.reverb.damping, params.reverb.mix, output_rate_kHz);
+    }
 
-    float *out = (float *)outputBuffer;
+    pipeline_length = 0;
+    pipeline[pipeline_length++] = &State::stage_modulation;
+    if (features & POST_LFO) {
+        pipeline[pipeline_length++] = &State::stage_vol_lfo;
+    }
+    if (features & POST_FILTER) {
+        pipeline[pipeline_length++] = &State::stage_filter;
+    }
+    pipeline[pipeline_length++] = &State::stage_gain;
+}
 
-    update_volume();
-    update_sounds();
-    update_filter_coefficients();
+// Walk the ramps one sample at a time into out, the same sums next() would do
+static void write_ramp(Ramp &ramp, float *out, unsigned long n) {
+    float value = ramp.value;
+    for (unsigned long i = 0; i < n; ++i) {
+        out[i] = value;
+        value += ramp.step;
+    }
+    ramp.value = value;
+}
 
-    for (unsigned long i = 0; i < framesPerBuffer; ++i) {
-        float sample = 0.0;
-        for (size_t j = 0; j < playing_sounds.size(); ++j) {
-            auto& opt_sound = playing_sounds[j];
-            if (!opt_sound.has_value()){
-                continue;
+// Control points fall every control_interval samples regardless of where
+// buffers and chunks start and end, in between the ramps the later stages
+// use are written out sample by sample
+void SynthEngine::State::stage_modulation(unsigned long samples, const SynthParams &params) {
+    Modulation &m = modulation;
+    Ramp *coefficients[5] = {&m.b0, &m.b1, &m.b2, &m.a1, &m.a2};
+    unsigned long i = 0;
+    while (i < samples) {
+        if (m.countdown == 0) {
+            control_update(params);
+        }
+        unsigned long n = std::min<unsigned long>(m.countdown, samples - i);
+        m.countdown -= n;
+        if (features & POST_LFO) {
+            write_ramp(m.lfo_gain, lfo_gain_buffer + i, n);
+        }
+        if (features & POST_FILTER) {
+            for (int c = 0; c < 5; ++c) {
+                write_ramp(*coefficients[c], coefficient_buffer[c] + i, n);
             }
-            Sound& sound = opt_sound.value();
-            sound.vol = std::clamp(sound.vol + sound.vol_step, 0.0f, sound.max_vol);
-            sample += p_sin * sound.vol * static_cast<float>(std::sin(sound.phase));
-            sample += p_saw * sound.vol * static_cast<float>((2.0 / M_PI) * (sound.phase - M_PI));
-            sample += p_square * sound.vol * static_cast<float>((sound.phase < M_PI) ? 1.0 : -1.0);
-            double phase_increment = 2.0 * M_PI * sound.frequency / SAMPLERATE_kHz;
-            sound.phase += phase_increment;
-            sound.phase = std::fmod(sound.phase, 2.0 * M_PI);
         }
+        write_ramp(m.master_gain, master_gain_buffer + i, n);
+        i += n;
+    }
+}
 
-        // Apply LFO to volume
-        sample = sample + sample * vol_lfo.amplitude * static_cast<float>(std::sin(vol_lfo.phase));
+void SynthEngine::State::stage_vol_lfo(unsigned long samples, const SynthParams &) {
+    for (unsigned c = 0; c < channels; ++c) {
+        float *mix = channel_mix(c);
+        for (unsigned long i = 0; i < samples; ++i) {
+            mix[i] *= lfo_gain_buffer[i];
+        }
+    }
+}
 
-        // Apply second-order low-pass filter
-        sample = (b0 / a0) * sample + (b1 / a0) * last_input + (b2 / a0) * last_input2
-                       - (a1 / a0) * last_output - (a2 / a0) * last_output2;
-        // Update previous inputs and outputs
-        last_input2 = last_input;
-        last_input = sample;  // Assuming 'sample' was the input
-        last_output2 = last_output;
-        last_output = sample;
+// second-order low-pass, direct form I. The recursion keeps this one serial,
+// but with the coefficients already laid out per sample it's nothing but the
+// filter itself
+void SynthEngine::State::stage_filter(unsigned long samples, const SynthParams &) {
+    const float *b0 = coefficient_buffer[0], *b1 = coefficient_buffer[1], *b2 = coefficient_buffer[2];
+    const float *a1 = coefficient_buffer[3], *a2 = coefficient_buffer[4];
+    for (unsigned c = 0; c < channels; ++c) {
+        float *mix = channel_mix(c);
+        BiquadHistory &h = filter_history[c];
+        float x1 = h.x1, x2 = h.x2, y1 = h.y1, y2 = h.y2;
+        for (unsigned long i = 0; i < samples; ++i) {
+            float x = mix[i];
+            float y = b0[i] * x + b1[i] * x1 + b2[i] * x2 - a1[i] * y1 - a2[i] * y2;
+            x2 = x1;
+            x1 = x;
+            y2 = y1;
+            y1 = y;
+            mix[i] = y;
+        }
+        h = {.x1 = x1, .x2 = x2, .y1 = y1, .y2 = y2};
+    }
+}
+
+void SynthEngine::State::stage_gain(unsigned long samples, const SynthParams &) {
+    for (unsigned c = 0; c < channels; ++c) {
+        float *mix = channel_mix(c);
+        for (unsigned long i = 0; i < samples; ++i) {
+            mix[i] *= master_gain_buffer[i];
+        }
+    }
+}
 
-        vol_lfo.phase += lfo_phase_increment;
-        vol_lfo.phase = std::fmod(vol_lfo.phase, 2.0 * M_PI);
-        filter_cutoff_lfo.phase += filter_cutoff_lfo_phase_increment;
-        filter_cutoff_lfo.phase = std::fmod(filter_cutoff_lfo.phase, 2.0 * M_PI);
+// Send effects and the stereo interleave, frames output rate samples in. A
+// mono chain passes the same buffer as left and right.
+void SynthEngine::State::write_output(const float *left, const float *right, float *out, unsigned long frames) {
+    if ((features & (POST_DELAY | POST_REVERB)) == 0) {
+        for (unsigned long j = 0; j < frames; ++j) {
+            out[2 * j] = left[j]; // Left channel
+            out[2 * j + 1] = right[j]; // Right channel
+        }
+        return;
+    }
+    if (features & POST_DELAY) {
+        delay.process(left, right, left_buffer, right_buffer, frames);
+    } else {
+        std::copy(left, left + frames, left_buffer);
+        std::copy(right, right + frames, right_buffer);
+    }
+    if (features & POST_REVERB) {
+        reverb.process(left_buffer, right_buffer, frames);
+    }
+    for (unsigned long j = 0; j < frames; ++j) {
+        out[2 * j] = left_buffer[j];
+        out[2 * j + 1] = right_buffer[j];
+    }
+}
 
-        *out++ = sample * gain; // Left channel
-        *out++ = sample * gain; // Right channel
+// Switch the output rate and/or oversampling factor. Everything that depends
+// on the render rate (phase increments, envelope segments, LFO steps, filter
+// coefficients, the crossfade length) follows from render_rate_kHz. Running
+// voices are rescaled so they keep their pitch and envelope timing; filter,
+// decimator and effect state starts from scratch.
+void SynthEngine::State::apply_render_rate(float rate_kHz, unsigned factor) {
+    float stretch = rate_kHz * factor / render_rate_kHz;
+    oversampling = factor;
+    output_rate_kHz = rate_kHz;
+    render_rate_kHz = rate_kHz * factor;
+    env_shape.attack *= stretch;
+    env_shape.decay *= stretch;
+    env_shape.release *= stretch;
+    env_shape.fade *= stretch;
+    for (size_t j = 0; j < voices.count; ++j) {
+        tune_voice(j);
+        envelope_resample(voices, j, stretch, env_shape);
+    }
+    for (unsigned c = 0; c < 2; ++c) {
+        decimate_first[c].reset();
+        decimate_last[c].reset();
+        filter_history[c] = {};
     }
+    delay.reset();
+    reverb.reset();
+    modulation.countdown = 0;
+    modulation.primed = false;
+    // build_pipeline() starts the voice filters over for the new rate
+    features &= ~POST_VOICE_FILTER;
+}
 
-    return paContinue;
+// Brings channel c's samples at the render rate down to the output rate,
+// returns the samples / oversampling output samples (in place in its buffer)
+const float *SynthEngine::State::decimate(unsigned c, unsigned long samples) {
+    float *mix = channel_mix(c);
+    if (oversampling >= 4) {
+        decimate_first[c].process(mix, samples, mix);
+        samples /= 2;
+    }
+    if (oversampling >= 2) {
+        decimate_last[c].process(mix, samples, mix);
+    }
+    return mix;
 }
 
+void SynthEngine::State::render_audio(float *out, unsigned long framesPerBuffer) {
+    // one consistent parameter set for the whole buffer
+    const SynthParams &params = params_buffer.read();
+
+    if (recording.load(std::memory_order_acquire)) {
+        record_params(params, !recorder_primed);
+        recorder_primed = true;
+    } else {
+        recorder_primed = false;
+    }
+
+    if (params.oversampling != oversampling || params.sample_rate_kHz != output_rate_kHz) {
+        apply_render_rate(params.sample_rate_kHz, params.oversampling);
+    }
+    if (params.program != program) {
+        // fade from whatever is playing right now, even if that's half way
+        // through the last fade
+        program = params.program;
+        wave_fade.from = wave_fade.at(0);
+        wave_fade.position = 0;
+        wave_fade.length = static_cast<unsigned long>(PATCH_CROSSFADE_ms * render_rate_kHz);
+    }
+    if (params.gain_change != gain_change) {
+        // from wherever the gain is now, so a ramp can be redirected half way
+        gain_change = params.gain_change;
+        target_gain = params.gain_target;
+        gain_step = (target_gain - gain) / std::max(params.gain_ramp_ms * output_rate_kHz, 1.0f);
+        gain_changing = gain_step != 0;
+    }
+    update_unison(params);
+    update_sounds(params);
+
+    // put together once per buffer, the parameters can't change before the next one
+    build_pipeline(params);
+
+    // MIX_BLOCK holds render rate samples, so chunks get shorter with oversampling
+    const unsigned os = oversampling;
+    const unsigned long chunk_frames = MIX_BLOCK / os;
+    for (unsigned long start = 0; start < framesPerBuffer; start += chunk_frames) {
+        unsigned long frames = std::min(chunk_frames, framesPerBuffer - start);
+        unsigned long samples = frames * os;
+        // render voices up to each note event, then apply it, so every event
+        // starts or stops its voice on its own frame
+        for (unsigned long i = 0; i < frames;) {
+            uint64_t next_event = apply_note_events(engine_frame + i, params);
+            unsigned long end = next_event < engine_frame + frames ? static_cast<unsigned long>(next_event - engine_frame) : frames;
+            render_voices(mix_buffer + i * os, channels == 2 ? mix_right_buffer + i * os : nullptr,
+                          (end - i) * os, params);
+            i = end;
+        }
 
+        for (size_t s = 0; s < pipeline_length; ++s) {
+            (this->*pipeline[s])(samples, params);
+        }
 
+        const float *left = decimate(0, samples);
+        write_output(left, channels == 2 ? decimate(1, samples) : left, out, frames);
+        out += 2 * frames;
+        engine_frame += frames;
+    }
+}
 
+void SynthEngine::render(std::span<float> out) {
+    state->render_audio(out.data(), out.size() / 2);
+}
+
+void SynthEngine::reset() {
+    State &s = *state;
+    for (NoteInput &input : s.note_inputs) {
+        while (input.queue.pop(input.held)) {}
+        input.has_held = false;
+    }
+    s.voices.clear();
+    s.wave_fade = WaveFade();
+    s.modulation = Modulation();
+    for (unsigned c = 0; c < 2; ++c) {
+        s.filter_history[c] = {};
+        s.decimate_first[c].reset();
+        s.decimate_last[c].reset();
+    }
+    s.delay.reset();
+    s.reverb.reset();
+}
 
-void set_LFO(float frequency, float magnitude) {
-    vol_lfo.frequency = frequency;
-    vol_lfo.amplitude = magnitude;
+size_t SynthEngine::get_active_voice_count() const {
+    return state->voices.count;
 }
 
-void set_key_freq_map(std::array<float, 256> map) {
-    key_freq_map = map;
+void SynthEngine::profile_update_sounds() {
+    state->update_sounds(state->params_buffer.read());
 }
 
-void set_envelope(float attack, float decay, float sustain, float release) {
+void SynthEngine::profile_control_update() {
+    state->control_update(state->params_buffer.read());
+}
+
+// copy the GUI's working parameters into the triple buffer for the audio thread
+void SynthEngine::State::publish_params() {
+    params_buffer.write_buffer() = pending_params;
+    params_buffer.publish();
+}
+
+void SynthEngine::set_LFO(float frequency, float magnitude) {
+    state->pending_params.vol_lfo.frequency = frequency;
+    state->pending_params.vol_lfo.amplitude = magnitude;
+    state->publish_params();
+}
+
+void SynthEngine::set_key_freq_map(std::array<float, 256> map) {
+    state->pending_params.key_freq_map = map;
+    state->publish_params();
+}
+
+void SynthEngine::set_envelope(float attack, float decay, float sustain, float release) {
+    Envelope &envelope = state->pending_params.envelope;
     envelope.attack = attack;
     envelope.decay = decay;
     envelope.sustain = sustain;
     envelope.release = release;
+    state->publish_params();
+}
+
+void SynthEngine::set_waveform(float sin, float saw, float square) {
+    state->pending_params.p_sin = sin;
+    state->pending_params.p_square = square;
+    state->pending_params.p_saw = saw;
+    state->publish_params();
+}
+
+// coefficients are derived from this on the audio thread, see control_update()
+void SynthEngine::set_filter(float cutoff_freq, float Q) {
+    state->pending_params.filter.cutoff = cutoff_freq;
+    state->pending_params.filter.Q = Q;
+    state->publish_params();
+}
+
+void SynthEngine::set_delay(float time, float feedback, float mix) {
+    state->pending_params.delay = {.time = time, .feedback = feedback, .mix = mix};
+    state->publish_params();
+}
+
+void SynthEngine::set_reverb(float time, float damping, float mix) {
+    state->pending_params.reverb = {.time = time, .damping = damping, .mix = mix};
+    state->publish_params();
+}
+
+void SynthEngine::set_unison(unsigned voices, float detune, float spread) {
+    // the stack size is clamped where it's used, see unison_count()
+    state->pending_params.unison = {.voices = static_cast<float>(voices), .detune = detune, .spread = spread};
+    state->publish_params();
 }
 
-void set_waveform(float sin, float saw, float square) {
-    p_sin = sin;
-    p_square = square;
-    p_saw = saw;
+void SynthEngine::set_filter_tracking(float key_track, float velocity) {
+    state->pending_params.filter.key_track = key_track;
+    state->pending_params.filter.velocity = velocity;
+    state->publish_params();
 }
 
-void set_filter(float cutoff_freq, float Q) {
-    filter.cutoff = cutoff_freq;
-    filter.Q = Q;
-    update_filter_coefficients();
+void SynthEngine::set_filter_bypass(bool bypass) {
+    state->pending_params.filter.bypass = bypass;
+    state->publish_params();
 }
 
-void set_cutoff_lfo(float frequency, float magnitude) {
-    filter_cutoff_lfo.frequency = frequency;
-    filter_cutoff_lfo.amplitude = magnitude;
+void SynthEngine::set_cutoff_lfo(float frequency, float magnitude) {
+    state->pending_params.filter_cutoff_lfo.frequency = frequency;
+    state->pending_params.filter_cutoff_lfo.amplitude = magnitude;
+    state->publish_params();
 }
 
-std::string note_buffer_to_string(std::vector<Note> note_buffer){
-    std::string nb_string = "";
-    for (int i = 0; i < note_buffer.size(); ++i) {
-        nb_string = fmt::format("{} {}", nb_string, note_buffer[i].key);
+void SynthEngine::set_control_interval(unsigned samples) {
+    state->pending_params.control_interval = std::clamp(samples, MIN_CONTROL_INTERVAL, MAX_CONTROL_INTERVAL);
+    state->publish_params();
+}
+
+void SynthEngine::set_polyphony(unsigned max_voices, StealPolicy policy) {
+    state->pending_params.max_polyphony = std::clamp(max_voices, 1u, static_cast<unsigned>(MAX_VOICES));
+    state->pending_params.steal_policy = policy;
+    state->publish_params();
+}
+
+void SynthEngine::set_params(std::span<const ParamChange> changes) {
+    for (const ParamChange &change : changes) {
+        if (change.id < PARAM_COUNT) {
+            write_param(state->pending_params, change.id, clamp_param(change.id, change.value));
+        }
     }
-    return nb_string;
+    state->publish_params();
 }
 
+float SynthEngine::get_param(ParamId id) const {
+    return read_param(state->pending_params, id);
+}
 
-void change_volume(float amount, float period) {
-    gain_step = amount / (SAMPLERATE_kHz * period / 1000); //(1/ms)
-    target_gain = std::clamp(gain + amount, 0.0f, 1.0f);
-    gain_changing = true;
-    //spdlog::debug("target gain = {:.2f} | step = {:.2f} ", target_gain, gain_step * 1000);
+void SynthEngine::load_patch(const Patch &patch) {
+    SynthParams &p = state->pending_params;
+    // banks are mapped straight from disk, so a damaged entry must not reach
+    // the audio thread: clamp like set_params()
+    for (int i = 0; i < PARAM_COUNT; ++i) {
+        const ParamId id = static_cast<ParamId>(i);
+        write_param(p, id, clamp_param(id, get_patch_param(patch, id)));
+    }
+    ++p.program;
+    state->publish_params();
 }
 
+Patch SynthEngine::get_patch() const {
+    Patch patch = {};
+    for (int i = 0; i < PARAM_COUNT; ++i) {
+        set_patch_param(patch, static_cast<ParamId>(i), get_param(static_cast<ParamId>(i)));
+    }
+    return patch;
+}
+
+void SynthEngine::set_sample_rate(float rate_kHz) {
+    state->pending_params.sample_rate_kHz = std::clamp(rate_kHz, MIN_SAMPLERATE_kHz, MAX_SAMPLERATE_kHz);
+    state->publish_params();
+}
+
+float SynthEngine::get_sample_rate() const {
+    return state->pending_params.sample_rate_kHz;
+}
+
+void SynthEngine::set_oversampling(unsigned factor) {
+    state->pending_params.oversampling = factor >= 4 ? 4 : factor >= 2 ? 2 : 1;
+    state->publish_params();
+}
+
+void SynthEngine::change_volume(float amount, float period) {
+    SynthParams &p = state->pending_params;
+    p.gain_target = std::clamp(p.gain_target + amount, 0.0f, 1.0f);
+    p.gain_ramp_ms = std::max(period, 0.0f) / 1000;  // period is in us
+    ++p.gain_change;
+    state->publish_params();
+}
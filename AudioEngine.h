@@ -1,37 +1,175 @@
 #ifndef AUDIO_ENGINE_H
 #define AUDIO_ENGINE_H
 
-#include <portaudio.h>
 #include <array>
-
-
-const float SAMPLERATE_kHz = 44.1;
-
-void change_volume(float amount, float period);
-
-void note_on(unsigned short key, unsigned short velocity);
-
-void note_off(unsigned short key);
-
-void set_key_freq_map(std::array<float, 256> map);
-
-void set_envelope(float attack, float decay, float sustain, float release);
-
-void set_LFO(float frequency, float magnitude);
-
-void set_cutoff_lfo(float frequency, float magnitude);
-
-void set_waveform(float p_sin, float p_saw, float s_square);
-
-void set_filter(float cutoff, float Q);
-
-int audioCallback(const void *inputBuffer, void *outputBuffer,
-                  unsigned long framesPerBuffer,
-                  const PaStreamCallbackTimeInfo *timeInfo,
-                  PaStreamCallbackFlags statusFlags,
-                  void *userData);
-
-extern float frequency;  // External global variable
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include "ParamRegistry.h"
+
+
+// Output sample rate unless set_sample_rate() says otherwise, and the range it takes
+constexpr float DEFAULT_SAMPLERATE_kHz = 44.1f;
+constexpr float MIN_SAMPLERATE_kHz = 8;
+constexpr float MAX_SAMPLERATE_kHz = 192;
+
+// Which voice gives way when a note needs a voice and the polyphony cap is
+// reached: the one started longest ago, the quietest one right now, or
+// released voices first (quietest of those), falling back to the oldest.
+enum StealPolicy {
+    STEAL_OLDEST, STEAL_QUIETEST, STEAL_RELEASED_FIRST
+};
+
+struct Patch;
+struct RecordedEvent;
+
+// One complete synth: voices, envelopes, modulation, filter and oversampling,
+// with nothing shared between instances apart from the read-only wavetables,
+// so a process can run as many as it likes (see Mixer.h).
+//
+// Threads: the note and set_* functions belong to one control thread (the
+// GUI), the remote_* functions to a second one (the OSC server), and
+// everything from sync_frame_clock() down to the rendering thread.
+class SynthEngine {
+public:
+    SynthEngine();
+    ~SynthEngine();
+    SynthEngine(const SynthEngine &) = delete;
+    SynthEngine &operator=(const SynthEngine &) = delete;
+
+    // ramp the master gain by amount (clamped to 0..1) over period microseconds
+    void change_volume(float amount, float period);
+
+    void note_on(unsigned short key, unsigned short velocity);
+
+    void note_off(unsigned short key);
+
+    // note_on()/note_off() at an exact engine frame (see get_engine_frame()), for
+    // sequencers and offline rendering. Frames must not go backwards from one
+    // event to the next; events already in the past play as soon as possible.
+    void note_on_at(unsigned short key, unsigned short velocity, uint64_t frame);
+    void note_off_at(unsigned short key, uint64_t frame);
+
+    // Note events from a second thread (the OSC server), which gets its own queue
+    // and frame clock since note_on()/note_off() belong to the GUI thread.
+    // received is when the message arrived; the audio thread reports how long
+    // after that each event was rendered through pop_remote_note_latency(), which
+    // only that same thread may call.
+    void remote_note_on(unsigned short key, unsigned short velocity, std::chrono::steady_clock::time_point received);
+    void remote_note_off(unsigned short key, std::chrono::steady_clock::time_point received);
+    bool pop_remote_note_latency(float &ms);
+
+    // number of note events dropped because the GUI -> audio queue was full
+    unsigned long long get_note_event_overflows() const;
+
+    void set_key_freq_map(std::array<float, 256> map);
+
+    void set_envelope(float attack, float decay, float sustain, float release);
+
+    void set_LFO(float frequency, float magnitude);
+
+    void set_cutoff_lfo(float frequency, float magnitude);
+
+    void set_waveform(float p_sin, float p_saw, float s_square);
+
+    void set_filter(float cutoff, float Q);
+
+    // How far (0..1) the cutoff follows each note's pitch and velocity. With
+    // either above 0 every voice gets a filter of its own, ahead of its
+    // envelope, instead of one on the mix; that costs a little per voice.
+    void set_filter_tracking(float key_track, float velocity);
+
+    // Takes the filter out of the signal path, and out of the per-sample work
+    void set_filter_bypass(bool bypass);
+
+    // Stereo ping-pong delay and reverb after the filter (see Effects.h), mix
+    // is the wet level on top of the dry signal. At mix 0 an effect is out of
+    // the signal path and costs nothing.
+    void set_delay(float time_ms, float feedback, float mix);
+    void set_reverb(float time_ms, float damping, float mix);
+
+    // Every voice plays a stack of `voices` oscillators (1..16) detuned across
+    // +-detune cents and panned across +-spread of the stereo field. A single
+    // oscillator, or no spread, keeps the voices mono.
+    void set_unison(unsigned voices, float detune_cents, float spread);
+
+    // At most max_voices notes sound at once (clamped to 1..256). Stolen voices
+    // fade out over a few ms instead of cutting off.
+    void set_polyphony(unsigned max_voices, StealPolicy policy);
+
+    // Registry parameters (see ParamRegistry.h) by ID, clamped to their ranges.
+    // A batch goes to the audio thread as one snapshot, so publishing only what
+    // changed since last time costs one copy however many there are.
+    void set_params(std::span<const ParamChange> changes);
+    float get_param(ParamId id) const;
+
+    // Program change: every parameter in patch goes to the audio thread in one
+    // snapshot, so it takes effect whole at the next buffer, and the waveform mix
+    // crossfades from the old patch over a few ms. Voices that are already
+    // playing keep going.
+    void load_patch(const Patch &patch);
+
+    // the current settings as a patch (with an empty name), for saving
+    Patch get_patch() const;
+
+    // Render voices, modulation and the filter at 1x, 2x or 4x the output rate
+    // and decimate back down, keeping aliasing and filter warping near Nyquist
+    // out of the output. Costs roughly factor times the CPU. Other values are
+    // rounded down to the nearest of those.
+    void set_oversampling(unsigned factor);
+
+    // Output sample rate in kHz (clamped to 8..192), whatever the stream was
+    // actually opened at. Takes effect from the next render() like the other
+    // parameters; envelope, LFO, filter and crossfade timing all follow it and
+    // running voices keep their pitch.
+    void set_sample_rate(float rate_kHz);
+    float get_sample_rate() const;
+
+    // How often (in samples) the LFOs, filter coefficients and gain are
+    // recomputed, they are ramped linearly in between. Clamped to 1..256.
+    void set_control_interval(unsigned samples);
+
+    // Called by the audio callback right before render(). Lets note_on() and
+    // note_off() timestamp events from the wall clock, without it they take
+    // effect at the start of the next buffer.
+    void sync_frame_clock(unsigned long framesPerBuffer);
+
+    // frame the next render() call starts at
+    uint64_t get_engine_frame() const;
+
+    // Event recording (see EventRecorder.h). While on, the rendering thread logs
+    // every note event with the frame it took effect at and every parameter
+    // change with the frame of the first buffer that used it, starting with all
+    // current settings. The control thread drains them with pop_recorded_event()
+    // often enough to keep the queue from filling; overflowed events are lost.
+    void set_recording(bool on);
+    bool pop_recorded_event(RecordedEvent &event);
+    unsigned long long get_recorded_event_overflows() const;
+
+    // Renders the next out.size() / 2 frames of interleaved stereo into out.
+    // Voices are spread over the worker pool when there are enough of them
+    // (and this isn't already running as a worker job).
+    void render(std::span<float> out);
+
+    // Silences every voice and clears filter and LFO state. Never while a
+    // stream is running.
+    void reset();
+
+    // voices currently sounding
+    size_t get_active_voice_count() const;
+
+    // The housekeeping steps of render() on their own (note events and
+    // envelope stages once per buffer, modulation once per control interval),
+    // so SynthBench can time them.
+    void profile_update_sounds();
+    void profile_control_update();
+
+private:
+    struct State;
+    std::unique_ptr<State> state;
+};
 
 
 #endif  // AUDIO_ENGINE_H
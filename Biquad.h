@@ -0,0 +1,52 @@
+#ifndef BIQUAD_H
+#define BIQUAD_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+// Biquad coefficients normalized so a0 == 1
+struct BiquadCoefficients {
+    float b0;
+    float b1;
+    float b2;
+    float a1;
+    float a2;
+};
+
+// Direct form I history: the last two inputs and outputs
+struct BiquadHistory {
+    float x1 = 0, x2 = 0;
+    float y1 = 0, y2 = 0;
+};
+
+// A bank of independent biquads in structure-of-arrays form: element j of
+// every array belongs to filter j, so SIMD code runs 4 or 8 of them per
+// instruction. Coefficients (b0 b1 b2 a1 a2) ramp linearly, moving by step
+// every sample; history is direct form I (x1 x2 y1 y2).
+constexpr size_t BIQUAD_COEFFICIENTS = 5;
+constexpr size_t BIQUAD_HISTORY = 4;
+
+struct BiquadLanes {
+    float *coefficient[BIQUAD_COEFFICIENTS];
+    float *step[BIQUAD_COEFFICIENTS];
+    float *history[BIQUAD_HISTORY];
+};
+
+// RBJ low-pass for an angular cutoff omega (radians per sample)
+inline BiquadCoefficients lowpass_coefficients(float omega, float Q) {
+    // keep clear of DC and Nyquist, where the filter goes unstable
+    omega = std::clamp(omega, 1e-4f, 0.99f * static_cast<float>(M_PI));
+    float cos_omega = std::cos(omega);
+    float alpha = std::sin(omega) / (2.0f * Q);  // Bandwidth
+    float a0 = 1 + alpha;
+    return {
+            .b0 = (1 - cos_omega) / 2.0f / a0,
+            .b1 = (1 - cos_omega) / a0,
+            .b2 = (1 - cos_omega) / 2.0f / a0,
+            .a1 = -2 * cos_omega / a0,
+            .a2 = (1 - alpha) / a0
+    };
+}
+
+#endif  // BIQUAD_H
@@ -0,0 +1,32 @@
+#ifndef CONTROL_RATE_H
+#define CONTROL_RATE_H
+
+// Modulation is evaluated every control interval instead of every sample.
+// Anything it drives moves in straight lines between control points.
+constexpr unsigned DEFAULT_CONTROL_INTERVAL = 32;
+constexpr unsigned MIN_CONTROL_INTERVAL = 1;
+constexpr unsigned MAX_CONTROL_INTERVAL = 256;
+
+// A value that moves linearly to a new target over a number of samples
+struct Ramp {
+    float value = 0;
+    float step = 0;
+
+    void set_target(float target, unsigned samples) {
+        step = (target - value) / samples;
+    }
+
+    // no ramp, used when there is no previous control point to come from
+    void jump(float target) {
+        value = target;
+        step = 0;
+    }
+
+    float next() {
+        float current = value;
+        value += step;
+        return current;
+    }
+};
+
+#endif  // CONTROL_RATE_H
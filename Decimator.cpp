@@ -0,0 +1,93 @@
+#include "Decimator.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// stopband around -80 dB for the lengths we use
+constexpr double KAISER_BETA = 8.0;
+
+// modified Bessel function of the first kind, order 0, for the Kaiser window
+static double bessel_i0(double x) {
+    double sum = 1, term = 1;
+    for (int k = 1; k < 32; ++k) {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+HalfbandDecimator::HalfbandDecimator(size_t half) : half(std::clamp<size_t>(half, 1, DECIMATOR_MAX_HALF)) {
+    // full filter h[0, 4*half - 1) centred on c = 2*half - 1. The even taps
+    // h[2m] are the ones left over once the centre is taken out
+    const double c = 2.0 * this->half - 1;
+    double sum = 0;
+    coeffs.fill(0);
+    for (size_t m = 0; m < 2 * this->half; ++m) {
+        double t = 2.0 * m - c;  // odd, never 0
+        double ratio = t / (c + 1);
+        double window = bessel_i0(KAISER_BETA * std::sqrt(std::max(0.0, 1 - ratio * ratio))) / bessel_i0(KAISER_BETA);
+        double h = std::sin(M_PI * t / 2) / (M_PI * t) * window;
+        coeffs[m] = static_cast<float>(h);
+        sum += h;
+    }
+    // unity gain at DC, the centre tap supplies the other half
+    for (size_t m = 0; m < 2 * this->half; ++m) {
+        coeffs[m] = static_cast<float>(coeffs[m] * 0.5 / sum);
+    }
+    reset();
+}
+
+void HalfbandDecimator::reset() {
+    even.fill(0);
+    odd.fill(0);
+}
+
+void HalfbandDecimator::process(const float *in, size_t samples, float *out) {
+    const size_t history = 2 * half;
+    const size_t outputs = samples / 2;
+    for (size_t k = 0; k < outputs; ++k) {
+        even[history + k] = in[2 * k];
+        odd[history + k] = in[2 * k + 1];
+    }
+
+    // y[n] = sum_m coeffs[m] * e[n - m] + 0.5 * o[n - half]
+    const float *e = even.data() + history;
+    const float *o = odd.data() + history - half;
+    const size_t taps = 2 * half;
+    size_t n = 0;
+#if defined(__SSE2__)
+    const __m128 centre = _mm_set1_ps(0.5f);
+    for (; n + 4 <= outputs; n += 4) {
+        __m128 acc = _mm_mul_ps(centre, _mm_loadu_ps(o + n));
+        for (size_t m = 0; m < taps; ++m) {
+            acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(coeffs[m]), _mm_loadu_ps(e + n - m)));
+        }
+        _mm_storeu_ps(out + n, acc);
+    }
+#elif defined(__ARM_NEON)
+    for (; n + 4 <= outputs; n += 4) {
+        float32x4_t acc = vmulq_n_f32(vld1q_f32(o + n), 0.5f);
+        for (size_t m = 0; m < taps; ++m) {
+            acc = vmlaq_n_f32(acc, vld1q_f32(e + n - m), coeffs[m]);
+        }
+        vst1q_f32(out + n, acc);
+    }
+#endif
+    for (; n < outputs; ++n) {
+        float acc = 0.5f * o[n];
+        for (size_t m = 0; m < taps; ++m) {
+            acc += coeffs[m] * e[n - m];
+        }
+        out[n] = acc;
+    }
+
+    // the newest samples become the next block's history
+    std::memmove(even.data(), even.data() + outputs, history * sizeof(float));
+    std::memmove(odd.data(), odd.data() + outputs, history * sizeof(float));
+}
@@ -0,0 +1,35 @@
+#ifndef DECIMATOR_H
+#define DECIMATOR_H
+
+#include <array>
+#include <cstddef>
+
+// longest input process() takes in one call
+constexpr size_t DECIMATOR_MAX_INPUT = 1024;
+// longest filter, in non-zero taps on each side of the centre
+constexpr size_t DECIMATOR_MAX_HALF = 16;
+
+// Half-band low-pass FIR that halves the sample rate, run in polyphase form.
+// Every other tap of a half-band filter is zero apart from the centre one (0.5),
+// so the odd input phase is just a delay and only the even phase needs a
+// real FIR, evaluated once per output sample. Both phases keep 2*half samples
+// of history in front of the block so the FIR runs over contiguous memory,
+// four outputs at a time with SSE/NEON.
+struct HalfbandDecimator {
+    // Kaiser windowed half-band with half non-zero taps per side (4*half - 1
+    // taps in total). Longer is steeper, use more for the last stage.
+    explicit HalfbandDecimator(size_t half);
+
+    void reset();
+
+    // samples must be even and at most DECIMATOR_MAX_INPUT, writes samples / 2
+    // outputs. out may be the same buffer as in.
+    void process(const float *in, size_t samples, float *out);
+
+    size_t half;
+    std::array<float, 2 * DECIMATOR_MAX_HALF> coeffs;  // even phase taps
+    alignas(16) std::array<float, 2 * DECIMATOR_MAX_HALF + DECIMATOR_MAX_INPUT / 2> even;
+    alignas(16) std::array<float, 2 * DECIMATOR_MAX_HALF + DECIMATOR_MAX_INPUT / 2> odd;
+};
+
+#endif  // DECIMATOR_H
@@ -0,0 +1,133 @@
+#include "Effects.h"
+#include <algorithm>
+#include <cmath>
+
+// Adding and taking away this much rounds anything far enough below it to
+// zero, so decaying feedback never ends up in denormals (which are slow)
+constexpr float DENORMAL_GUARD = 1e-15f;
+
+static float flush_denormal(float x) {
+    return (x + DENORMAL_GUARD) - DENORMAL_GUARD;
+}
+
+static size_t ring_size(float samples) {
+    size_t size = 1;
+    while (size < samples) {
+        size *= 2;
+    }
+    return size;
+}
+
+StereoDelay::StereoDelay(float max_rate_kHz) {
+    size_t size = ring_size(MAX_DELAY_ms * max_rate_kHz + 1);
+    left_line.assign(size, 0.0f);
+    right_line.assign(size, 0.0f);
+    mask = size - 1;
+}
+
+void StereoDelay::reset() {
+    std::fill(left_line.begin(), left_line.end(), 0.0f);
+    std::fill(right_line.begin(), right_line.end(), 0.0f);
+    pos = 0;
+}
+
+void StereoDelay::set(float time_ms, float feedback, float mix, float rate_kHz) {
+    time_ms = std::clamp(time_ms, MIN_DELAY_ms, MAX_DELAY_ms);
+    delay = std::clamp<size_t>(static_cast<size_t>(std::lround(time_ms * rate_kHz)), 1, mask);
+    this->feedback = std::clamp(feedback, 0.0f, MAX_DELAY_FEEDBACK);
+    this->mix = mix;
+}
+
+void StereoDelay::process(const float *in_left, const float *in_right, float *left, float *right, size_t frames) {
+    // at most delay samples at a time, so nothing written is read back in the same step
+    for (size_t start = 0; start < frames;) {
+        size_t n = std::min(frames - start, delay);
+        for (size_t i = start; i < start + n; ++i) {
+            size_t write = (pos + i - start) & mask;
+            size_t read = (write - delay) & mask;
+            float l = left_line[read], r = right_line[read];
+            float in = 0.5f * (in_left[i] + in_right[i]);
+            left_line[write] = flush_denormal(in + feedback * r);
+            right_line[write] = flush_denormal(feedback * l);
+            left[i] = in_left[i] + mix * l;
+            right[i] = in_right[i] + mix * r;
+        }
+        pos = (pos + n) & mask;
+        start += n;
+    }
+}
+
+// ms, spread out so no two lines share a factor that would pile up their echoes
+constexpr float FDN_LENGTHS_ms[FDN_LINES] = {31.3f, 37.9f, 41.7f, 47.3f, 53.1f, 59.9f, 67.3f, 73.7f};
+// the input goes in with alternating signs so the lines don't start out correlated
+constexpr float FDN_INPUT_SIGN[FDN_LINES] = {1, -1, 1, -1, 1, -1, 1, -1};
+// each side sums half the lines
+constexpr float FDN_OUTPUT_SCALE = 0.25f;
+
+FdnReverb::FdnReverb(float max_rate_kHz) {
+    line_size = ring_size(FDN_LENGTHS_ms[FDN_LINES - 1] * max_rate_kHz + FDN_BLOCK);
+    mask = line_size - 1;
+    lines.assign(FDN_LINES * line_size, 0.0f);
+    length.fill(FDN_BLOCK);
+}
+
+void FdnReverb::reset() {
+    std::fill(lines.begin(), lines.end(), 0.0f);
+    lowpass.fill(0.0f);
+    pos = 0;
+}
+
+void FdnReverb::set(float time_ms, float damping, float mix, float rate_kHz) {
+    time_ms = std::max(time_ms, MIN_REVERB_ms);
+    for (size_t l = 0; l < FDN_LINES; ++l) {
+        length[l] = std::clamp<size_t>(static_cast<size_t>(std::lround(FDN_LENGTHS_ms[l] * rate_kHz)),
+                                       FDN_BLOCK, line_size - FDN_BLOCK);
+        // a pass through line l has to take its share of 60 dB over time_ms
+        gain[l] = std::pow(10.0f, -3.0f * length[l] / (time_ms * rate_kHz));
+    }
+    this->damping = std::clamp(damping, 0.0f, 1.0f);
+    this->mix = mix;
+}
+
+void FdnReverb::process(float *left, float *right, size_t frames) {
+    const float d = damping;
+    for (size_t start = 0; start < frames; start += FDN_BLOCK) {
+        size_t n = std::min(FDN_BLOCK, frames - start);
+        // read the block's delayed samples out of every line
+        for (size_t l = 0; l < FDN_LINES; ++l) {
+            const float *line = lines.data() + l * line_size;
+            size_t read = pos - length[l];
+            for (size_t i = 0; i < n; ++i) {
+                block[i][l] = line[(read + i) & mask];
+            }
+        }
+        // damp, mix through the matrix and feed back, all lines side by side
+        for (size_t i = 0; i < n; ++i) {
+            float *v = block[i];
+            float in = 0.5f * (left[start + i] + right[start + i]);
+            float sum = 0;
+            for (size_t l = 0; l < FDN_LINES; ++l) {
+                lowpass[l] = gain[l] * ((1 - d) * v[l] + d * lowpass[l]);
+                sum += lowpass[l];
+            }
+            float wet_left = 0, wet_right = 0;
+            for (size_t l = 0; l < FDN_LINES; l += 2) {
+                wet_left += lowpass[l];
+                wet_right += lowpass[l + 1];
+            }
+            float reflect = sum * (2.0f / FDN_LINES);
+            for (size_t l = 0; l < FDN_LINES; ++l) {
+                v[l] = flush_denormal(lowpass[l] - reflect + FDN_INPUT_SIGN[l] * in);
+            }
+            left[start + i] += mix * FDN_OUTPUT_SCALE * wet_left;
+            right[start + i] += mix * FDN_OUTPUT_SCALE * wet_right;
+        }
+        for (size_t l = 0; l < FDN_LINES; ++l) {
+            float *line = lines.data() + l * line_size;
+            for (size_t i = 0; i < n; ++i) {
+                line[(pos + i) & mask] = block[i][l];
+            }
+        }
+        pos = (pos + n) & mask;
+    }
+}
@@ -0,0 +1,76 @@
+#ifndef EFFECTS_H
+#define EFFECTS_H
+
+#include <array>
+#include <cstddef>
+#include <vector>
+
+// Send effects, run at the output rate after the filter and gain. Both leave
+// the dry signal alone and add mix times their wet signal, so at mix 0 they
+// are left out of the chain and cost nothing. Their delay lines are allocated
+// once, for the longest time at the highest sample rate, and never resized.
+
+// longest delay time, ms
+constexpr float MAX_DELAY_ms = 1000;
+constexpr float MIN_DELAY_ms = 1;
+// past this the repeats would never die away
+constexpr float MAX_DELAY_FEEDBACK = 0.95f;
+
+// Ping-pong delay: the input, summed to mono, goes into the left line and each
+// line feeds the other, so repeats alternate between the sides.
+struct StereoDelay {
+    explicit StereoDelay(float max_rate_kHz);
+
+    void reset();
+
+    // takes effect from the next process(), the lines keep what they hold
+    void set(float time_ms, float feedback, float mix, float rate_kHz);
+
+    // left and right = in_left and in_right + mix * the repeats, frames at a
+    // time. A mono input passes the same buffer for both.
+    void process(const float *in_left, const float *in_right, float *left, float *right, size_t frames);
+
+    std::vector<float> left_line, right_line;
+    size_t mask;
+    size_t pos = 0;
+    size_t delay = 1;  // samples
+    float feedback = 0;
+    float mix = 0;
+};
+
+// Feedback delay network reverb: FDN_LINES delay lines of mutually unrelated
+// lengths, each damped by a one-pole low-pass, fed back through a Householder
+// matrix. The matrix is I - 2/N * ones, so mixing is one sum and one subtract
+// per line, which runs across all the lines at once in SIMD registers.
+//
+// Every line is longer than FDN_BLOCK samples, so a block of delayed samples
+// can be read out, mixed and written back without any of it feeding itself.
+constexpr size_t FDN_LINES = 8;
+constexpr size_t FDN_BLOCK = 64;
+constexpr float MIN_REVERB_ms = 10;
+
+struct FdnReverb {
+    explicit FdnReverb(float max_rate_kHz);
+
+    void reset();
+
+    // time_ms is the decay to -60 dB, damping 0..1 how much faster the highs
+    // die away. Takes effect from the next process().
+    void set(float time_ms, float damping, float mix, float rate_kHz);
+
+    // adds mix times the reverb of (left + right) / 2 to left and right
+    void process(float *left, float *right, size_t frames);
+
+    std::vector<float> lines;  // FDN_LINES lines of line_size, back to back
+    size_t line_size;
+    size_t mask;
+    size_t pos = 0;
+    std::array<size_t, FDN_LINES> length = {};
+    alignas(32) std::array<float, FDN_LINES> gain = {};
+    alignas(32) std::array<float, FDN_LINES> lowpass = {};
+    float damping = 0;
+    float mix = 0;
+    alignas(32) float block[FDN_BLOCK][FDN_LINES];
+};
+
+#endif  // EFFECTS_H
@@ -0,0 +1,149 @@
+#include "EnvelopeGenerator.h"
+#include <algorithm>
+#include <cmath>
+
+// How far past its target an exponential segment aims, as a fraction of the
+// distance it covers. Smaller is a more curved (more RC like) segment.
+constexpr float CURVE_OVERSHOOT = 0.001f;
+
+EnvelopeShape envelope_shape(float attack_ms, float decay_ms, float sustain, float release_ms,
+                             float fade_ms, float rate_kHz) {
+    return {
+            .attack = std::max(0.0f, attack_ms * rate_kHz),
+            .decay = std::max(0.0f, decay_ms * rate_kHz),
+            .sustain = std::clamp(sustain, 0.0f, 1.0f),
+            .release = std::max(0.0f, release_ms * rate_kHz),
+            .fade = std::max(0.0f, fade_ms * rate_kHz)
+    };
+}
+
+static void hold(VoicePool &voices, size_t v, float level) {
+    voices.vol[v] = level;
+    voices.env_target[v] = level;
+    voices.env_mul[v] = 1;
+    voices.env_add[v] = 0;
+    voices.env_remaining[v] = ENVELOPE_HOLD;
+}
+
+// false (and the level jumps to target) if there's nothing to do
+static bool start_linear(VoicePool &voices, size_t v, float target, float samples) {
+    uint32_t n = static_cast<uint32_t>(std::ceil(samples));
+    float level = voices.vol[v];
+    if (n == 0 || level == target) {
+        voices.vol[v] = target;
+        return false;
+    }
+    voices.env_target[v] = target;
+    voices.env_mul[v] = 1;
+    voices.env_add[v] = (target - level) / n;
+    voices.env_remaining[v] = n;
+    return true;
+}
+
+// Heads for a point CURVE_OVERSHOOT past target, with the rate picked so the
+// curve crosses target after exactly samples steps:
+//   level_n = aim + (level_0 - aim) * k^n,  aim = target - r * (level_0 - target)
+//   level_n == target  =>  k^n = r / (1 + r)
+static bool start_exponential(VoicePool &voices, size_t v, float target, float samples) {
+    uint32_t n = static_cast<uint32_t>(std::ceil(samples));
+    float level = voices.vol[v];
+    if (n == 0 || level == target) {
+        voices.vol[v] = target;
+        return false;
+    }
+    float aim = target - CURVE_OVERSHOOT * (level - target);
+    float k = static_cast<float>(std::pow(CURVE_OVERSHOOT / (1.0 + CURVE_OVERSHOOT), 1.0 / n));
+    voices.env_target[v] = target;
+    voices.env_mul[v] = k;
+    voices.env_add[v] = (1 - k) * aim;
+    voices.env_remaining[v] = n;
+    return true;
+}
+
+void envelope_enter(VoicePool &voices, size_t v, EnvelopeStage stage, const EnvelopeShape &shape) {
+    voices.stage[v] = stage;
+    const float peak = voices.max_vol[v];
+    switch (stage) {
+        case ATTACK: {
+            // linear, at the slope that takes silence to the peak in shape.attack,
+            // so a retrigger from part way up gets there sooner
+            float samples = peak > 0 ? shape.attack * std::max(0.0f, peak - voices.vol[v]) / peak : 0;
+            if (!start_linear(voices, v, peak, samples)) {
+                envelope_enter(voices, v, DECAY, shape);
+            }
+            break;
+        }
+        case DECAY:
+            if (!start_exponential(voices, v, peak * shape.sustain, shape.decay)) {
+                envelope_enter(voices, v, SUSTAIN, shape);
+            }
+            break;
+        case SUSTAIN:
+            hold(voices, v, peak * shape.sustain);
+            break;
+        case RELEASE:
+            if (!start_exponential(voices, v, 0, shape.release)) {
+                hold(voices, v, 0);
+            }
+            break;
+        case STOLEN:
+            if (!start_linear(voices, v, 0, shape.fade)) {
+                hold(voices, v, 0);
+            }
+            break;
+    }
+}
+
+// voice v just reached the end of its segment
+static void next_segment(VoicePool &voices, size_t v, const EnvelopeShape &shape) {
+    voices.vol[v] = voices.env_target[v];
+    switch (voices.stage[v]) {
+        case ATTACK: envelope_enter(voices, v, DECAY, shape); break;
+        case DECAY: envelope_enter(voices, v, SUSTAIN, shape); break;
+        default: hold(voices, v, voices.env_target[v]); break;
+    }
+}
+
+void envelope_resample(VoicePool &voices, size_t v, float factor, const EnvelopeShape &shape) {
+    if (voices.env_remaining[v] == ENVELOPE_HOLD) {
+        return;
+    }
+    float samples = voices.env_remaining[v] * factor;
+    bool running = voices.env_mul[v] == 1 ? start_linear(voices, v, voices.env_target[v], samples)
+                                          : start_exponential(voices, v, voices.env_target[v], samples);
+    if (!running) {
+        next_segment(voices, v, shape);
+    }
+}
+
+void render_envelopes(VoicePool &voices, size_t first, size_t count, unsigned long frames,
+                      const EnvelopeShape &shape, float *env, size_t stride) {
+    float *__restrict level = voices.vol.data() + first;
+    const float *__restrict mul = voices.env_mul.data() + first;
+    const float *__restrict add = voices.env_add.data() + first;
+    uint32_t *remaining = voices.env_remaining.data() + first;
+
+    for (unsigned long done = 0; done < frames;) {
+        // every voice steps in lockstep up to the first segment end
+        uint32_t run = static_cast<uint32_t>(frames - done);
+        for (size_t j = 0; j < count; ++j) {
+            run = std::min(run, remaining[j]);
+        }
+        for (uint32_t i = 0; i < run; ++i) {
+            float *__restrict row = env + (done + i) * stride;
+            for (size_t j = 0; j < count; ++j) {
+                level[j] = level[j] * mul[j] + add[j];
+                row[j] = level[j];
+            }
+        }
+        for (size_t j = 0; j < count; ++j) {
+            if (remaining[j] != ENVELOPE_HOLD) {
+                remaining[j] -= run;
+                if (remaining[j] == 0) {
+                    next_segment(voices, first + j, shape);
+                }
+            }
+        }
+        done += run;
+    }
+}
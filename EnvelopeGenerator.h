@@ -0,0 +1,52 @@
+#ifndef ENVELOPE_GENERATOR_H
+#define ENVELOPE_GENERATOR_H
+
+#include "VoicePool.h"
+#include <cstddef>
+#include <cstdint>
+
+// Sample-accurate ADSR. Every stage is a segment with a length in samples,
+// worked out when the voice enters it, and every segment is the same
+// recurrence level = level * mul + add: mul 1 for a straight line, mul < 1 for
+// an exponential curve heading for (just past) its target. Segments end on
+// their exact sample and land on their target, so attack doesn't overshoot and
+// decay doesn't undershoot sustain however the buffers fall.
+//
+// Levels are rendered a block at a time into a frame-major buffer, one column
+// per voice, stepping every voice in lockstep so the inner loop vectorizes
+// across voices. The run is only cut short where some voice changes stage.
+
+// frames rendered per call, the buffer holds this many rows
+constexpr unsigned long ENVELOPE_BLOCK = 64;
+// env_remaining of a segment that holds until something else happens
+// (sustain, or a finished release)
+constexpr uint32_t ENVELOPE_HOLD = UINT32_MAX;
+
+// Segment lengths in samples at the render rate, worked out once per buffer
+struct EnvelopeShape {
+    float attack;   // from silence to the peak
+    float decay;    // from the peak to sustain
+    float sustain;  // fraction of the peak
+    float release;  // to silence
+    float fade;     // stolen voices, to silence
+};
+
+EnvelopeShape envelope_shape(float attack_ms, float decay_ms, float sustain, float release_ms,
+                             float fade_ms, float rate_kHz);
+
+// Start stage for voice v from wherever its level is now. Zero length
+// segments are skipped straight away.
+void envelope_enter(VoicePool &voices, size_t v, EnvelopeStage stage, const EnvelopeShape &shape);
+
+// The render rate changed by factor (new / old): stretch what is left of voice
+// v's segment so it still ends at the same time
+void envelope_resample(VoicePool &voices, size_t v, float factor, const EnvelopeShape &shape);
+
+// Advances voices [first, first + count) by frames (at most ENVELOPE_BLOCK)
+// samples and writes the level of voice first + j at frame i to
+// env[i * stride + j]. Voices in different ranges can be rendered on
+// different threads.
+void render_envelopes(VoicePool &voices, size_t first, size_t count, unsigned long frames,
+                      const EnvelopeShape &shape, float *env, size_t stride);
+
+#endif  // ENVELOPE_GENERATOR_H
@@ -0,0 +1,155 @@
+#include "EventRecorder.h"
+#include "AudioEngine.h"
+#include "ParamRegistry.h"
+#include "PatchBank.h"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <cmath>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+constexpr char RECORDING_MAGIC[8] = {'S', 'Y', 'N', 'T', 'H', 'R', 'E', 'C'};
+constexpr size_t HEADER_SIZE = 24;
+constexpr size_t RECORD_V1_SIZE = 16;
+
+static uint16_t read_u16(const unsigned char *p) {
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+static uint32_t read_u32(const unsigned char *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+static void put_u16(std::vector<unsigned char> &out, uint16_t value) {
+    out.push_back(value & 0xff);
+    out.push_back(value >> 8);
+}
+
+static void put_u32(std::vector<unsigned char> &out, uint32_t value) {
+    for (int b = 0; b < 4; ++b) {
+        out.push_back((value >> (8 * b)) & 0xff);
+    }
+}
+
+bool write_recording(const std::string &path, const EventRecording &recording) {
+    std::vector<unsigned char> out;
+    out.reserve(HEADER_SIZE + recording.events.size() * RECORD_V1_SIZE);
+    out.insert(out.end(), RECORDING_MAGIC, RECORDING_MAGIC + sizeof(RECORDING_MAGIC));
+    put_u16(out, RECORDING_VERSION);
+    put_u16(out, RECORD_V1_SIZE);
+    put_u32(out, static_cast<uint32_t>(std::lround(recording.sample_rate_kHz * 1000)));
+    put_u32(out, static_cast<uint32_t>(recording.events.size()));
+    put_u32(out, 0);
+    for (const RecordedEvent &event : recording.events) {
+        put_u32(out, static_cast<uint32_t>(event.frame));
+        put_u32(out, static_cast<uint32_t>(event.frame >> 32));
+        out.push_back(event.type);
+        out.push_back(event.part);
+        put_u16(out, event.id);
+        uint32_t bits;
+        std::memcpy(&bits, &event.value, 4);
+        put_u32(out, bits);
+    }
+
+    std::ofstream file(path, std::ios::binary);
+    file.write(reinterpret_cast<const char *>(out.data()), static_cast<std::streamsize>(out.size()));
+    if (!file) {
+        spdlog::error("could not write recording {}: {}", path, std::strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool read_recording(const std::string &path, EventRecording &recording) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        spdlog::error("could not open recording {}", path);
+        return false;
+    }
+    std::vector<unsigned char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    const char *problem = nullptr;
+    size_t record_size = 0, count = 0;
+    if (data.size() < HEADER_SIZE || std::memcmp(data.data(), RECORDING_MAGIC, sizeof(RECORDING_MAGIC)) != 0) {
+        problem = "not a recording";
+    } else {
+        record_size = read_u16(&data[10]);
+        count = read_u32(&data[16]);
+        if (read_u16(&data[8]) == 0 || record_size < RECORD_V1_SIZE) {
+            problem = "unsupported version";
+        } else if (count > (data.size() - HEADER_SIZE) / record_size) {
+            problem = "truncated";
+        }
+    }
+    if (problem != nullptr) {
+        spdlog::error("{}: {}", path, problem);
+        return false;
+    }
+
+    recording.sample_rate_kHz = read_u32(&data[12]) / 1000.0f;
+    recording.events.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        const unsigned char *p = &data[HEADER_SIZE + i * record_size];
+        RecordedEvent &event = recording.events[i];
+        event.frame = read_u32(p) | (static_cast<uint64_t>(read_u32(p + 4)) << 32);
+        event.type = static_cast<RecordedEventType>(p[8]);
+        event.part = p[9];
+        event.id = read_u16(p + 10);
+        uint32_t bits = read_u32(p + 12);
+        std::memcpy(&event.value, &bits, 4);
+        if (event.type >= REC_EVENT_TYPES || (event.type == REC_PARAM && event.id >= PARAM_COUNT)) {
+            spdlog::error("{}: bad event {}", path, i);
+            return false;
+        }
+    }
+    std::stable_sort(recording.events.begin(), recording.events.end(),
+                     [](const RecordedEvent &a, const RecordedEvent &b) { return a.frame < b.frame; });
+    return true;
+}
+
+bool is_recording_file(const std::string &path) {
+    char magic[sizeof(RECORDING_MAGIC)] = {};
+    std::ifstream file(path, std::ios::binary);
+    file.read(magic, sizeof(magic));
+    return file && std::memcmp(magic, RECORDING_MAGIC, sizeof(magic)) == 0;
+}
+
+void apply_recorded_event(const RecordedEvent &event, SynthEngine &engine, std::array<float, 256> &key_map) {
+    unsigned short key = event.id & 0xff;
+    switch (event.type) {
+        case REC_NOTE_ON:
+            engine.note_on_at(key, static_cast<unsigned short>(event.value), event.frame);
+            break;
+        case REC_NOTE_OFF:
+            engine.note_off_at(key, event.frame);
+            break;
+        case REC_PARAM: {
+            ParamChange change = {static_cast<ParamId>(event.id), event.value};
+            engine.set_params({&change, 1});
+            break;
+        }
+        case REC_KEY_FREQ:
+            key_map[key] = event.value;
+            engine.set_key_freq_map(key_map);
+            break;
+        case REC_POLYPHONY:
+            engine.set_polyphony(static_cast<unsigned>(event.value), static_cast<StealPolicy>(event.id));
+            break;
+        case REC_OVERSAMPLING:
+            engine.set_oversampling(static_cast<unsigned>(event.value));
+            break;
+        case REC_CONTROL_INTERVAL:
+            engine.set_control_interval(static_cast<unsigned>(event.value));
+            break;
+        case REC_SAMPLE_RATE:
+            engine.set_sample_rate(event.value);
+            break;
+        case REC_PROGRAM:
+            // the new parameters came just before, this only starts the crossfade
+            engine.load_patch(engine.get_patch());
+            break;
+        case REC_EVENT_TYPES:
+            break;
+    }
+}
@@ -0,0 +1,66 @@
+#ifndef EVENT_RECORDER_H
+#define EVENT_RECORDER_H
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class SynthEngine;
+
+// Everything that changes what an engine renders, stamped with the engine
+// frame it took effect at. SynthEngine::set_recording() captures these from
+// the audio thread, so replaying a recording through the same build gives the
+// same samples whatever buffer size either run used.
+enum RecordedEventType : uint8_t {
+    REC_NOTE_ON,           // id key, value velocity
+    REC_NOTE_OFF,          // id key
+    REC_PARAM,             // id ParamId, value
+    REC_KEY_FREQ,          // id key, value frequency in kHz
+    REC_POLYPHONY,         // id StealPolicy, value max voices
+    REC_OVERSAMPLING,      // value factor
+    REC_CONTROL_INTERVAL,  // value samples
+    REC_SAMPLE_RATE,       // value kHz
+    REC_PROGRAM,           // a program change, crossfading to the parameters recorded before it
+    REC_EVENT_TYPES
+};
+
+struct RecordedEvent {
+    uint64_t frame;
+    RecordedEventType type;
+    uint8_t part;  // Mixer part, filled in by whoever drains the engine
+    uint16_t id;
+    float value;
+};
+
+struct EventRecording {
+    float sample_rate_kHz;  // output rate when recording started
+    std::vector<RecordedEvent> events;  // by frame
+};
+
+// File, all little endian:
+//
+//   header   "SYNTHREC", u16 version, u16 record size, u32 sample rate in Hz,
+//            u32 event count, u32 reserved
+//   records  u64 frame, u8 type, u8 part, u16 id, f32 value (16 bytes)
+//
+// Readers skip whatever a longer record has past the fields they know.
+constexpr uint16_t RECORDING_VERSION = 1;
+
+// false (and logs why) if the file can't be written or read
+bool write_recording(const std::string &path, const EventRecording &recording);
+bool read_recording(const std::string &path, EventRecording &recording);
+
+// true if path starts with the recording magic
+bool is_recording_file(const std::string &path);
+
+inline bool is_note_event(const RecordedEvent &event) {
+    return event.type == REC_NOTE_ON || event.type == REC_NOTE_OFF;
+}
+
+// Replays one event into engine, note events are queued for event.frame and
+// everything else applies from the next render(). key_map is the engine's key
+// frequency map as the replay has built it so far.
+void apply_recorded_event(const RecordedEvent &event, SynthEngine &engine, std::array<float, 256> &key_map);
+
+#endif  // EVENT_RECORDER_H
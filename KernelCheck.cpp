@@ -0,0 +1,35 @@
+// Checks the SIMD oscillator kernels against the scalar one, for CTest.
+// select_oscillator_kernel() quietly falls back to a narrower kernel when one
+// is off, this fails instead so the regression gets noticed. Kernels the CPU
+// can't run are skipped, and with none left the test reports itself skipped.
+
+#include "OscillatorKernel.h"
+#include <spdlog/spdlog.h>
+#include <initializer_list>
+
+// CTest's SKIP_RETURN_CODE for this test
+constexpr int SKIPPED = 77;
+
+int main() {
+    unsigned checked = 0;
+    bool passed = true;
+    for (OscKernelType type : {OSC_SSE41, OSC_AVX2}) {
+        float error = oscillator_kernel_error(type);
+        if (error < 0) {
+            spdlog::info("{} kernel not supported here, skipped", oscillator_kernel_name(type));
+            continue;
+        }
+        ++checked;
+        if (error > KERNEL_TOLERANCE) {
+            spdlog::error("{} kernel off by {} from scalar (tolerance {})", oscillator_kernel_name(type), error,
+                          KERNEL_TOLERANCE);
+            passed = false;
+        } else {
+            spdlog::info("{} kernel within {} of scalar", oscillator_kernel_name(type), error);
+        }
+    }
+    if (!passed) {
+        return 1;
+    }
+    return checked == 0 ? SKIPPED : 0;
+}
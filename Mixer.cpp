@@ -0,0 +1,61 @@
+#include "Mixer.h"
+#include "WorkerPool.h"
+#include <algorithm>
+
+// frames rendered per part before summing, longer buffers go in chunks
+constexpr size_t MIXER_BLOCK = 1024;
+
+Mixer::Mixer(size_t count) {
+    count = std::max<size_t>(count, 1);
+    for (size_t i = 0; i < count; ++i) {
+        parts.push_back(std::make_unique<SynthEngine>());
+    }
+    // allocated up front, render() runs on the audio thread
+    part_buffers.resize(count, std::vector<float>(2 * MIXER_BLOCK));
+}
+
+void Mixer::sync_frame_clock(unsigned long framesPerBuffer) {
+    for (auto &part : parts) {
+        part->sync_frame_clock(framesPerBuffer);
+    }
+}
+
+struct PartJobs {
+    Mixer *mixer;
+    std::vector<std::vector<float>> *buffers;
+    float *out;
+    size_t samples;
+};
+
+static void render_part_job(void *context, unsigned job, unsigned /*thread*/) {
+    const PartJobs &jobs = *static_cast<const PartJobs *>(context);
+    float *target = job == 0 ? jobs.out : (*jobs.buffers)[job].data();
+    jobs.mixer->part(job).render(std::span<float>(target, jobs.samples));
+}
+
+void Mixer::render(std::span<float> out) {
+    if (parts.size() == 1) {
+        parts[0]->render(out);
+        return;
+    }
+    for (size_t start = 0; start < out.size(); start += 2 * MIXER_BLOCK) {
+        size_t samples = std::min(2 * MIXER_BLOCK, out.size() - start);
+        float *chunk = out.data() + start;
+        PartJobs jobs = {.mixer = this, .buffers = &part_buffers, .out = chunk, .samples = samples};
+        run_parallel(render_part_job, &jobs, static_cast<unsigned>(parts.size()));
+        for (size_t p = 1; p < parts.size(); ++p) {
+            const float *part = part_buffers[p].data();
+            for (size_t i = 0; i < samples; ++i) {
+                chunk[i] += part[i];
+            }
+        }
+    }
+}
+
+size_t Mixer::get_active_voice_count() const {
+    size_t voices = 0;
+    for (const auto &part : parts) {
+        voices += part->get_active_voice_count();
+    }
+    return voices;
+}
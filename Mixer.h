@@ -0,0 +1,46 @@
+#ifndef MIXER_H
+#define MIXER_H
+
+#include "AudioEngine.h"
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <vector>
+
+// Multi-timbral output: N independent engines ("parts"), each with its own
+// patch, voices and note queues, summed into one stereo stream. With the
+// worker pool running every part renders on its own thread into a buffer of
+// its own, and then doesn't spread its voices over the pool as well.
+//
+// The parts are fixed at construction. part() and part_count() are fine from
+// any thread, everything else belongs to the rendering thread like the
+// engine's own render().
+class Mixer {
+public:
+    explicit Mixer(size_t parts);
+
+    SynthEngine &part(size_t index) {
+        return *parts[index];
+    }
+
+    size_t part_count() const {
+        return parts.size();
+    }
+
+    // SynthEngine::sync_frame_clock() for every part
+    void sync_frame_clock(unsigned long framesPerBuffer);
+
+    // Renders the next out.size() / 2 frames of interleaved stereo, the sum of
+    // every part, into out
+    void render(std::span<float> out);
+
+    // voices sounding across all parts
+    size_t get_active_voice_count() const;
+
+private:
+    std::vector<std::unique_ptr<SynthEngine>> parts;
+    // one interleaved chunk per part, parts[0] renders straight into out
+    std::vector<std::vector<float>> part_buffers;
+};
+
+#endif  // MIXER_H
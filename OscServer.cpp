@@ -0,0 +1,348 @@
+#include "OscServer.h"
+#include "Mixer.h"
+#include "ParamRegistry.h"
+#include "SpscQueue.h"
+#include <spdlog/spdlog.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cmath>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+// latency histogram in 0.05 ms buckets up to 50 ms, anything past that lands in the last one
+constexpr size_t LATENCY_BUCKETS = 1001;
+constexpr float LATENCY_BUCKET_ms = 0.05f;
+// how often the listener wakes up with no packets, to collect latencies and check for stop
+constexpr int POLL_TIMEOUT_ms = 10;
+// bundles inside bundles, deeper than this is treated as malformed
+constexpr int MAX_BUNDLE_DEPTH = 4;
+constexpr size_t MAX_PACKET = 2048;
+
+enum OscAddress {
+    ADDR_NOTE_ON, ADDR_NOTE_OFF, ADDR_ENVELOPE, ADDR_LFO, ADDR_CUTOFF_LFO,
+    ADDR_WAVEFORM, ADDR_FILTER, ADDR_POLYPHONY, ADDR_PROGRAM, ADDR_PARAM
+};
+
+struct AddressSpec {
+    const char *path;
+    OscAddress address;
+    int arg_count;
+};
+
+static const AddressSpec ADDRESSES[] = {
+        {"/synth/note_on", ADDR_NOTE_ON, 2},
+        {"/synth/note_off", ADDR_NOTE_OFF, 1},
+        {"/synth/envelope", ADDR_ENVELOPE, 4},
+        {"/synth/lfo", ADDR_LFO, 2},
+        {"/synth/cutoff_lfo", ADDR_CUTOFF_LFO, 2},
+        {"/synth/waveform", ADDR_WAVEFORM, 3},
+        {"/synth/filter", ADDR_FILTER, 2},
+        {"/synth/polyphony", ADDR_POLYPHONY, 2},
+        {"/synth/program", ADDR_PROGRAM, 1},
+        {"/synth/param", ADDR_PARAM, 2},
+};
+
+struct LatencyHistogram {
+    std::array<unsigned long long, LATENCY_BUCKETS> buckets = {};
+    unsigned long long count = 0;
+    double sum = 0;
+    float min = 0;
+    float max = 0;
+
+    void add(float ms) {
+        size_t bucket = std::min(LATENCY_BUCKETS - 1, static_cast<size_t>(std::max(0.0f, ms) / LATENCY_BUCKET_ms));
+        ++buckets[bucket];
+        if (count == 0) {
+            min = max = ms;
+        }
+        ++count;
+        sum += ms;
+        min = std::min(min, ms);
+        max = std::max(max, ms);
+    }
+
+    // upper edge of the bucket holding the given quantile
+    float quantile(double q) const {
+        unsigned long long target = static_cast<unsigned long long>(q * count);
+        unsigned long long seen = 0;
+        for (size_t i = 0; i < LATENCY_BUCKETS; ++i) {
+            seen += buckets[i];
+            if (seen > target) {
+                return std::min(max, (i + 1) * LATENCY_BUCKET_ms);
+            }
+        }
+        return max;
+    }
+};
+
+static SpscQueue<OscParamMessage, 256> param_messages;
+// set by start_osc_server(), notes go straight to its parts
+static Mixer *mixer = nullptr;
+
+static int server_socket = -1;
+static std::thread listener;
+static std::atomic<bool> running{false};
+
+// written by the listener thread, read by whoever asks for a summary
+static std::mutex stats_mutex;
+static LatencyHistogram latencies;
+static unsigned long long messages = 0;
+static unsigned long long malformed = 0;
+
+static uint32_t read_u32(const char *p) {
+    uint32_t word;
+    std::memcpy(&word, p, 4);
+    return ntohl(word);
+}
+
+// null terminated string padded to a multiple of 4, advances p past it
+static const char *read_string(const char *&p, const char *end) {
+    const char *terminator = static_cast<const char *>(std::memchr(p, 0, end - p));
+    if (terminator == nullptr) {
+        return nullptr;
+    }
+    const char *s = p;
+    size_t padded = ((terminator - p) / 4 + 1) * 4;
+    if (padded > static_cast<size_t>(end - p)) {
+        return nullptr;
+    }
+    p += padded;
+    return s;
+}
+
+// Reads up to args.size() numeric arguments, returns how many there were or -1
+// if the message is malformed or has an argument type we don't take. NaN and
+// infinities (or doubles past float range) count as malformed, so nothing
+// further on has to guard its arithmetic and casts against them.
+template <size_t N>
+static int read_args(const char *types, const char *p, const char *end, std::array<float, N> &args) {
+    int count = 0;
+    for (const char *t = types + 1; *t != 0; ++t) {
+        float value;
+        switch (*t) {
+            case 'i': {
+                if (end - p < 4) return -1;
+                value = static_cast<float>(static_cast<int32_t>(read_u32(p)));
+                p += 4;
+                break;
+            }
+            case 'f': {
+                if (end - p < 4) return -1;
+                uint32_t bits = read_u32(p);
+                std::memcpy(&value, &bits, 4);
+                p += 4;
+                break;
+            }
+            case 'h':
+            case 'd': {
+                if (end - p < 8) return -1;
+                uint64_t bits = (static_cast<uint64_t>(read_u32(p)) << 32) | read_u32(p + 4);
+                if (*t == 'h') {
+                    value = static_cast<float>(static_cast<int64_t>(bits));
+                } else {
+                    double d;
+                    std::memcpy(&d, &bits, 8);
+                    value = static_cast<float>(d);
+                }
+                p += 8;
+                break;
+            }
+            case 'T': value = 1; break;
+            case 'F': value = 0; break;
+            default:
+                return -1;
+        }
+        if (!std::isfinite(value)) {
+            return -1;
+        }
+        if (count < static_cast<int>(args.size())) {
+            args[count] = value;
+        }
+        ++count;
+    }
+    return count;
+}
+
+static bool handle_message(const char *p, const char *end, std::chrono::steady_clock::time_point received) {
+    const char *path = read_string(p, end);
+    if (path == nullptr) {
+        return false;
+    }
+    const char *types = read_string(p, end);
+    if (types == nullptr || types[0] != ',') {
+        return false;
+    }
+    const AddressSpec *spec = nullptr;
+    for (const AddressSpec &candidate : ADDRESSES) {
+        if (std::strcmp(candidate.path, path) == 0) {
+            spec = &candidate;
+        }
+    }
+    // every message takes an optional trailing part index, part 0 without it
+    std::array<float, 5> a = {};
+    int count = spec == nullptr ? -1 : read_args(types, p, end, a);
+    if (spec == nullptr || (count != spec->arg_count && count != spec->arg_count + 1)) {
+        return false;
+    }
+    float part_arg = count > spec->arg_count ? a[spec->arg_count] : 0.0f;
+    if (!(part_arg >= 0 && part_arg < mixer->part_count())) {
+        return false;
+    }
+    unsigned part = static_cast<unsigned>(part_arg);
+    SynthEngine &engine = mixer->part(part);
+    OscParamMessage message = {.type = OSC_PARAM, .part = part, .args = {}};  // type is set below
+    std::copy_n(a.begin(), message.args.size(), message.args.begin());
+
+    auto key = [](float value) {
+        return static_cast<unsigned short>(std::clamp(value, 0.0f, 255.0f));
+    };
+    switch (spec->address) {
+        case ADDR_NOTE_ON:
+            engine.remote_note_on(key(a[0]), static_cast<unsigned short>(std::clamp(a[1], 0.0f, 255.0f)), received);
+            return true;
+        case ADDR_NOTE_OFF:
+            engine.remote_note_off(key(a[0]), received);
+            return true;
+        case ADDR_ENVELOPE: message.type = OSC_ENVELOPE; break;
+        case ADDR_LFO: message.type = OSC_LFO; break;
+        case ADDR_CUTOFF_LFO: message.type = OSC_CUTOFF_LFO; break;
+        case ADDR_WAVEFORM: message.type = OSC_WAVEFORM; break;
+        case ADDR_FILTER: message.type = OSC_FILTER; break;
+        case ADDR_POLYPHONY: message.type = OSC_POLYPHONY; break;
+        case ADDR_PROGRAM: message.type = OSC_PROGRAM; break;
+        case ADDR_PARAM:
+            if (!(a[0] >= 0 && a[0] < static_cast<float>(PARAM_COUNT))) {
+                return false;
+            }
+            message.type = OSC_PARAM;
+            message.args[0] = std::floor(a[0]);
+            break;
+    }
+    param_messages.push(message);
+    return true;
+}
+
+// a message or a bundle, counting well formed and malformed messages into good and bad
+static void handle_packet(const char *p, const char *end, std::chrono::steady_clock::time_point received,
+                          int depth, unsigned long long &good, unsigned long long &bad) {
+    static const char BUNDLE_TAG[8] = "#bundle";
+    if (end - p >= 16 && std::memcmp(p, BUNDLE_TAG, 8) == 0) {
+        if (depth >= MAX_BUNDLE_DEPTH) {
+            ++bad;
+            return;
+        }
+        p += 16;  // tag and timetag, everything plays as soon as it arrives
+        while (end - p >= 4) {
+            uint32_t size = read_u32(p);
+            p += 4;
+            if (size % 4 != 0 || size > static_cast<uint32_t>(end - p)) {
+                ++bad;
+                return;
+            }
+            handle_packet(p, p + size, received, depth + 1, good, bad);
+            p += size;
+        }
+        return;
+    }
+    if (handle_message(p, end, received)) {
+        ++good;
+    } else {
+        ++bad;
+    }
+}
+
+static void listener_loop() {
+    alignas(4) char packet[MAX_PACKET];
+    pollfd fd = {.fd = server_socket, .events = POLLIN, .revents = 0};
+    while (running.load(std::memory_order_relaxed)) {
+        unsigned long long good = 0, bad = 0;
+        if (poll(&fd, 1, POLL_TIMEOUT_ms) > 0) {
+            // take everything that's already waiting before looking at latencies
+            ssize_t size;
+            while ((size = recv(server_socket, packet, sizeof(packet), MSG_DONTWAIT)) > 0) {
+                auto received = std::chrono::steady_clock::now();
+                if (size % 4 != 0) {
+                    ++bad;
+                    continue;
+                }
+                handle_packet(packet, packet + size, received, 0, good, bad);
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(stats_mutex);
+        messages += good;
+        malformed += bad;
+        float ms;
+        for (size_t part = 0; part < mixer->part_count(); ++part) {
+            while (mixer->part(part).pop_remote_note_latency(ms)) {
+                latencies.add(ms);
+            }
+        }
+    }
+}
+
+bool start_osc_server(unsigned short port, Mixer &target) {
+    if (running.load()) {
+        return true;
+    }
+    mixer = &target;
+    server_socket = socket(AF_INET, SOCK_DGRAM, 0);
+    if (server_socket < 0) {
+        spdlog::error("could not create OSC socket: {}", std::strerror(errno));
+        return false;
+    }
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(server_socket, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0) {
+        spdlog::error("could not bind OSC socket to 127.0.0.1:{}: {}", port, std::strerror(errno));
+        close(server_socket);
+        server_socket = -1;
+        return false;
+    }
+    running.store(true);
+    listener = std::thread(listener_loop);
+    spdlog::info("OSC server listening on 127.0.0.1:{}", port);
+    return true;
+}
+
+void stop_osc_server() {
+    if (!running.exchange(false)) {
+        return;
+    }
+    listener.join();
+    close(server_socket);
+    server_socket = -1;
+    OscLatencySummary s = get_osc_latency();
+    spdlog::info("OSC: {} messages, {} malformed, note latency avg {:.2f} ms p99 {:.2f} ms max {:.2f} ms",
+                 s.messages, s.malformed, s.avg_ms, s.p99_ms, s.max_ms);
+    if (param_messages.overflow_count() > 0) {
+        spdlog::warn("{} OSC parameter messages dropped, GUI fell behind", param_messages.overflow_count());
+    }
+}
+
+bool pop_osc_param(OscParamMessage &message) {
+    return param_messages.pop(message);
+}
+
+OscLatencySummary get_osc_latency() {
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    return {
+            .messages = messages,
+            .malformed = malformed,
+            .rendered = latencies.count,
+            .min_ms = latencies.min,
+            .avg_ms = latencies.count ? static_cast<float>(latencies.sum / latencies.count) : 0.0f,
+            .p99_ms = latencies.quantile(0.99),
+            .max_ms = latencies.max
+    };
+}
@@ -0,0 +1,61 @@
+#ifndef OSC_SERVER_H
+#define OSC_SERVER_H
+
+#include <array>
+
+class Mixer;
+
+// OSC over UDP on localhost, for driving the synth from sequencers on the same
+// machine. A listener thread decodes packets in place (no allocation) and
+// sends notes straight to the audio thread through each Mixer part's remote
+// note queue. Parameter changes are queued for the GUI thread instead, which
+// owns the set_* functions. Messages (plain or inside bundles, timetags ignored):
+//
+//   /synth/note_on <key> <velocity>
+//   /synth/note_off <key>
+//   /synth/envelope <attack_ms> <decay_ms> <sustain> <release_ms>
+//   /synth/lfo <frequency_kHz> <amplitude>
+//   /synth/cutoff_lfo <frequency_kHz> <amplitude>
+//   /synth/waveform <sin> <saw> <square>
+//   /synth/filter <cutoff_kHz> <Q>
+//   /synth/polyphony <max_voices> <policy>
+//   /synth/program <index>   (patch in the GUI's bank)
+//   /synth/param <id> <value>   (any parameter by ParamId, see ParamRegistry.h)
+//
+// Every message takes one more, optional, argument: the Mixer part it is for
+// (0 without it). Arguments can be int32, float32, int64 or double.
+
+constexpr unsigned short DEFAULT_OSC_PORT = 9000;
+
+enum OscParamType {
+    OSC_ENVELOPE, OSC_LFO, OSC_CUTOFF_LFO, OSC_WAVEFORM, OSC_FILTER, OSC_POLYPHONY, OSC_PROGRAM, OSC_PARAM
+};
+
+struct OscParamMessage {
+    OscParamType type;
+    unsigned part;
+    std::array<float, 4> args;
+};
+
+// receive-to-render latency of note messages, since start_osc_server()
+struct OscLatencySummary {
+    unsigned long long messages;   // well formed messages received
+    unsigned long long malformed;  // packets or messages that didn't decode
+    unsigned long long rendered;   // note events the audio thread has rendered
+    float min_ms;
+    float avg_ms;
+    float p99_ms;
+    float max_ms;
+};
+
+// Binds 127.0.0.1:port and starts the listener thread, which plays notes on
+// mixer's parts. Returns false and logs if the socket can't be set up.
+bool start_osc_server(unsigned short port, Mixer &mixer);
+void stop_osc_server();
+
+// GUI thread: next parameter change received, false if there are none
+bool pop_osc_param(OscParamMessage &message);
+
+OscLatencySummary get_osc_latency();
+
+#endif  // OSC_SERVER_H
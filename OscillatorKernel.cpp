@@ -0,0 +1,630 @@
+#include "OscillatorKernel.h"
+#include "Wavetable.h"
+#include <cmath>
+#include <algorithm>
+#include <array>
+#include <initializer_list>
+#include <spdlog/spdlog.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define OSC_X86 1
+#include <immintrin.h>
+#endif
+
+// The filtered SIMD kernels work out the waveforms of this many frames before
+// filtering them. Run sample by sample, every sample's table reads would wait
+// on the previous sample's filter and the CPU couldn't get ahead with them.
+constexpr unsigned long FILTER_RUN = 64;
+
+// No waveform has any weight, so there is nothing to add to out: just move
+// every voice on by frames samples
+static void advance_silent(float *, unsigned long frames, const OscVoices &voices, const WaveMix &) {
+    for (size_t j = 0; j < voices.count; ++j) {
+        voices.phase[j] += voices.phase_inc[j] * static_cast<uint32_t>(frames);  // wraps around at one cycle
+    }
+}
+
+static void advance_silent_stereo(float *, float *, unsigned long frames, const OscVoices &voices, const WaveMix &) {
+    advance_silent(nullptr, frames, voices, {});
+}
+
+// Reference implementation, one voice at a time. WAVES is the WaveBits of the
+// waveforms evaluated, the weights of the others are never looked at. STEREO
+// also adds every voice into right, scaled by env_right. FILTER runs each
+// voice through its filter lane before the envelope.
+template <unsigned WAVES, bool STEREO, bool FILTER>
+static void render_scalar_into(float *out, float *out_right, unsigned long frames, const OscVoices &voices,
+                               const WaveMix &wave) {
+    const Wavetables &tables = get_wavetables();
+    const BiquadLanes &filter = voices.filter;
+    for (size_t j = 0; j < voices.count; ++j) {
+        uint32_t phase = voices.phase[j];
+        const uint32_t inc = voices.phase_inc[j];
+        const float *env = voices.env + j;
+        const float *env_right = STEREO ? voices.env_right + j : nullptr;
+        const size_t level = wavetable_level(inc) * WAVETABLE_STRIDE;
+        const float *saw = tables.saw.data() + level;
+        const float *square = tables.square.data() + level;
+        float c[BIQUAD_COEFFICIENTS], step[BIQUAD_COEFFICIENTS], h[BIQUAD_HISTORY];
+        if constexpr (FILTER) {
+            for (size_t k = 0; k < BIQUAD_COEFFICIENTS; ++k) {
+                c[k] = filter.coefficient[k][j];
+                step[k] = filter.step[k][j];
+            }
+            for (size_t k = 0; k < BIQUAD_HISTORY; ++k) {
+                h[k] = filter.history[k][j];
+            }
+        }
+        for (unsigned long i = 0; i < frames; ++i) {
+            float sample = 0;
+            if constexpr ((WAVES & WAVE_SIN) != 0) sample += wave.sin * wavetable_read(tables.sine.data(), phase);
+            if constexpr ((WAVES & WAVE_SAW) != 0) sample += wave.saw * wavetable_read(saw, phase);
+            if constexpr ((WAVES & WAVE_SQUARE) != 0) sample += wave.square * wavetable_read(square, phase);
+            if constexpr (FILTER) {
+                // The input term last: the history terms only wait on earlier
+                // samples, so the SIMD kernels work them out while this
+                // sample's table reads are still coming in
+                float y = c[1] * h[0] + c[2] * h[1] - c[4] * h[3] - c[3] * h[2] + c[0] * sample;
+                h[1] = h[0];
+                h[0] = sample;
+                h[3] = h[2];
+                h[2] = y;
+                sample = y;
+                for (size_t k = 0; k < BIQUAD_COEFFICIENTS; ++k) {
+                    c[k] += step[k];
+                }
+            }
+            out[i] += env[i * voices.env_stride] * sample;
+            if constexpr (STEREO) {
+                out_right[i] += env_right[i * voices.env_stride] * sample;
+            }
+            phase += inc;  // wraps around at one cycle
+        }
+        voices.phase[j] = phase;
+        if constexpr (FILTER) {
+            for (size_t k = 0; k < BIQUAD_COEFFICIENTS; ++k) {
+                filter.coefficient[k][j] = c[k];
+            }
+            for (size_t k = 0; k < BIQUAD_HISTORY; ++k) {
+                filter.history[k][j] = h[k];
+            }
+        }
+    }
+}
+
+// VARIANT is an index into the kernel tables, WaveBits plus OSC_FILTERED
+template <unsigned VARIANT>
+static void render_scalar(float *out, unsigned long frames, const OscVoices &voices, const WaveMix &wave) {
+    render_scalar_into<VARIANT & WAVE_ALL, false, (VARIANT & OSC_FILTERED) != 0>(out, nullptr, frames, voices, wave);
+}
+
+template <unsigned VARIANT>
+static void render_scalar_stereo(float *left, float *right, unsigned long frames, const OscVoices &voices,
+                                 const WaveMix &wave) {
+    render_scalar_into<VARIANT & WAVE_ALL, true, (VARIANT & OSC_FILTERED) != 0>(left, right, frames, voices, wave);
+}
+
+#ifdef OSC_X86
+
+// SSE has no gather, so the four table reads per waveform are done by hand
+__attribute__((target("sse4.1")))
+static inline __m128 table_read_sse(const float *table, __m128i index, __m128i offset, __m128 frac) {
+    __m128i i = _mm_add_epi32(index, offset);
+    int i0 = _mm_extract_epi32(i, 0), i1 = _mm_extract_epi32(i, 1);
+    int i2 = _mm_extract_epi32(i, 2), i3 = _mm_extract_epi32(i, 3);
+    __m128 a = _mm_setr_ps(table[i0], table[i1], table[i2], table[i3]);
+    __m128 b = _mm_setr_ps(table[i0 + 1], table[i1 + 1], table[i2 + 1], table[i3 + 1]);
+    return _mm_add_ps(a, _mm_mul_ps(frac, _mm_sub_ps(b, a)));
+}
+
+__attribute__((target("sse4.1")))
+static inline float horizontal_sum_sse(__m128 v) {
+    __m128 shuf = _mm_movehdup_ps(v);
+    __m128 sums = _mm_add_ps(v, shuf);
+    sums = _mm_add_ss(sums, _mm_movehl_ps(shuf, sums));
+    return _mm_cvtss_f32(sums);
+}
+
+// A lane group of the filter bank held in registers, see BiquadLanes
+struct BiquadGroupSse {
+    __m128 c[BIQUAD_COEFFICIENTS];
+    __m128 step[BIQUAD_COEFFICIENTS];
+    __m128 h[BIQUAD_HISTORY];
+};
+
+__attribute__((target("sse4.1")))
+static inline void biquad_load_sse(BiquadGroupSse &g, const BiquadLanes &lanes, size_t j) {
+    for (size_t k = 0; k < BIQUAD_COEFFICIENTS; ++k) {
+        g.c[k] = _mm_loadu_ps(lanes.coefficient[k] + j);
+        g.step[k] = _mm_loadu_ps(lanes.step[k] + j);
+    }
+    for (size_t k = 0; k < BIQUAD_HISTORY; ++k) {
+        g.h[k] = _mm_loadu_ps(lanes.history[k] + j);
+    }
+}
+
+__attribute__((target("sse4.1")))
+static inline void biquad_store_sse(const BiquadGroupSse &g, const BiquadLanes &lanes, size_t j) {
+    for (size_t k = 0; k < BIQUAD_COEFFICIENTS; ++k) {
+        _mm_storeu_ps(lanes.coefficient[k] + j, g.c[k]);
+    }
+    for (size_t k = 0; k < BIQUAD_HISTORY; ++k) {
+        _mm_storeu_ps(lanes.history[k] + j, g.h[k]);
+    }
+}
+
+// one sample through every filter of the group, same sums as the scalar kernel
+__attribute__((target("sse4.1")))
+static inline __m128 biquad_sse(BiquadGroupSse &g, __m128 x) {
+    __m128 y = _mm_add_ps(_mm_mul_ps(g.c[1], g.h[0]), _mm_mul_ps(g.c[2], g.h[1]));
+    y = _mm_sub_ps(y, _mm_mul_ps(g.c[4], g.h[3]));
+    y = _mm_sub_ps(y, _mm_mul_ps(g.c[3], g.h[2]));
+    y = _mm_add_ps(y, _mm_mul_ps(g.c[0], x));
+    g.h[1] = g.h[0];
+    g.h[0] = x;
+    g.h[3] = g.h[2];
+    g.h[2] = y;
+    for (size_t k = 0; k < BIQUAD_COEFFICIENTS; ++k) {
+        g.c[k] = _mm_add_ps(g.c[k], g.step[k]);
+    }
+    return y;
+}
+
+// the WAVES waveforms of a lane group at phase, weighted
+template <unsigned WAVES>
+__attribute__((target("sse4.1")))
+static inline __m128 wave_mix_sse(const Wavetables &tables, __m128i phase, __m128i level, const WaveMix &wave) {
+    const __m128i index = _mm_srli_epi32(phase, WAVETABLE_FRAC_BITS);
+    const __m128 frac = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(phase, _mm_set1_epi32(WAVETABLE_FRAC_MASK))),
+                                   _mm_set1_ps(WAVETABLE_FRAC_SCALE));
+    __m128 sample = _mm_setzero_ps();
+    if constexpr ((WAVES & WAVE_SIN) != 0) {
+        sample = _mm_mul_ps(_mm_set1_ps(wave.sin), table_read_sse(tables.sine.data(), index, _mm_setzero_si128(), frac));
+    }
+    if constexpr ((WAVES & WAVE_SAW) != 0) {
+        sample = _mm_add_ps(sample, _mm_mul_ps(_mm_set1_ps(wave.saw), table_read_sse(tables.saw.data(), index, level, frac)));
+    }
+    if constexpr ((WAVES & WAVE_SQUARE) != 0) {
+        sample = _mm_add_ps(sample, _mm_mul_ps(_mm_set1_ps(wave.square), table_read_sse(tables.square.data(), index, level, frac)));
+    }
+    return sample;
+}
+
+template <unsigned WAVES, bool STEREO, bool FILTER>
+__attribute__((target("sse4.1")))
+static void render_sse41_into(float *out, float *out_right, unsigned long frames, const OscVoices &voices,
+                              const WaveMix &wave) {
+    const Wavetables &tables = get_wavetables();
+
+    for (size_t j = 0; j < voices.count; j += 4) {
+        // lanes past the last voice read and write dead pool slots but their
+        // output is masked off (and their table index kept in range)
+        const int live = static_cast<int>(std::min<size_t>(4, voices.count - j));
+        const __m128i live_lanes = _mm_cmpgt_epi32(_mm_set1_epi32(live), _mm_setr_epi32(0, 1, 2, 3));
+        const __m128 live_mask = _mm_castsi128_ps(live_lanes);
+        alignas(16) int32_t levels[4];
+        for (int lane = 0; lane < 4; ++lane) {
+            levels[lane] = lane < live ? static_cast<int32_t>(wavetable_level(voices.phase_inc[j + lane]) * WAVETABLE_STRIDE) : 0;
+        }
+        const __m128i level = _mm_load_si128(reinterpret_cast<const __m128i *>(levels));
+        __m128i phase = _mm_loadu_si128(reinterpret_cast<const __m128i *>(voices.phase + j));
+        const __m128i inc = _mm_loadu_si128(reinterpret_cast<const __m128i *>(voices.phase_inc + j));
+        const float *env = voices.env + j;
+        const float *env_right = STEREO ? voices.env_right + j : nullptr;
+        BiquadGroupSse filter;
+        if constexpr (FILTER) {
+            biquad_load_sse(filter, voices.filter, j);
+        }
+
+        // one pass over all the frames, or with the filter a FILTER_RUN at a time
+        for (unsigned long start = 0; start < frames;) {
+            const unsigned long end = FILTER ? std::min(frames, start + FILTER_RUN) : frames;
+            alignas(16) float raw[FILTER ? FILTER_RUN * 4 : 1];
+            if constexpr (FILTER) {
+                for (unsigned long i = start; i < end; ++i) {
+                    _mm_store_ps(raw + (i - start) * 4, wave_mix_sse<WAVES>(tables, phase, level, wave));
+                    phase = _mm_add_epi32(phase, inc);
+                }
+            }
+            for (unsigned long i = start; i < end; ++i) {
+                const __m128 vol = _mm_loadu_ps(env + i * voices.env_stride);
+                __m128 sample;
+                if constexpr (FILTER) {
+                    // dead lanes get silence, so their (zero) history stays zero
+                    sample = biquad_sse(filter, _mm_and_ps(_mm_load_ps(raw + (i - start) * 4), live_mask));
+                } else {
+                    sample = wave_mix_sse<WAVES>(tables, phase, level, wave);
+                    phase = _mm_add_epi32(phase, inc);
+                }
+                if constexpr (STEREO) {
+                    const __m128 vol_right = _mm_loadu_ps(env_right + i * voices.env_stride);
+                    out_right[i] += horizontal_sum_sse(_mm_and_ps(_mm_mul_ps(vol_right, sample), live_mask));
+                }
+                out[i] += horizontal_sum_sse(_mm_and_ps(_mm_mul_ps(vol, sample), live_mask));
+            }
+            start = end;
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(voices.phase + j), phase);
+        if constexpr (FILTER) {
+            biquad_store_sse(filter, voices.filter, j);
+        }
+    }
+}
+
+template <unsigned VARIANT>
+__attribute__((target("sse4.1")))
+static void render_sse41(float *out, unsigned long frames, const OscVoices &voices, const WaveMix &wave) {
+    render_sse41_into<VARIANT & WAVE_ALL, false, (VARIANT & OSC_FILTERED) != 0>(out, nullptr, frames, voices, wave);
+}
+
+template <unsigned VARIANT>
+__attribute__((target("sse4.1")))
+static void render_sse41_stereo(float *left, float *right, unsigned long frames, const OscVoices &voices,
+                                const WaveMix &wave) {
+    render_sse41_into<VARIANT & WAVE_ALL, true, (VARIANT & OSC_FILTERED) != 0>(left, right, frames, voices, wave);
+}
+
+__attribute__((target("avx2,fma")))
+static inline __m256 table_read_avx2(const float *table, __m256i index, __m256 frac) {
+    __m256 a = _mm256_i32gather_ps(table, index, 4);
+    __m256 b = _mm256_i32gather_ps(table + 1, index, 4);
+    return _mm256_fmadd_ps(frac, _mm256_sub_ps(b, a), a);
+}
+
+__attribute__((target("avx2,fma")))
+static inline float horizontal_sum_avx2(__m256 v) {
+    __m128 sums = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    __m128 shuf = _mm_movehdup_ps(sums);
+    sums = _mm_add_ps(sums, shuf);
+    sums = _mm_add_ss(sums, _mm_movehl_ps(shuf, sums));
+    return _mm_cvtss_f32(sums);
+}
+
+struct BiquadGroupAvx2 {
+    __m256 c[BIQUAD_COEFFICIENTS];
+    __m256 step[BIQUAD_COEFFICIENTS];
+    __m256 h[BIQUAD_HISTORY];
+};
+
+__attribute__((target("avx2,fma")))
+static inline void biquad_load_avx2(BiquadGroupAvx2 &g, const BiquadLanes &lanes, size_t j) {
+    for (size_t k = 0; k < BIQUAD_COEFFICIENTS; ++k) {
+        g.c[k] = _mm256_loadu_ps(lanes.coefficient[k] + j);
+        g.step[k] = _mm256_loadu_ps(lanes.step[k] + j);
+    }
+    for (size_t k = 0; k < BIQUAD_HISTORY; ++k) {
+        g.h[k] = _mm256_loadu_ps(lanes.history[k] + j);
+    }
+}
+
+__attribute__((target("avx2,fma")))
+static inline void biquad_store_avx2(const BiquadGroupAvx2 &g, const BiquadLanes &lanes, size_t j) {
+    for (size_t k = 0; k < BIQUAD_COEFFICIENTS; ++k) {
+        _mm256_storeu_ps(lanes.coefficient[k] + j, g.c[k]);
+    }
+    for (size_t k = 0; k < BIQUAD_HISTORY; ++k) {
+        _mm256_storeu_ps(lanes.history[k] + j, g.h[k]);
+    }
+}
+
+__attribute__((target("avx2,fma")))
+static inline __m256 biquad_avx2(BiquadGroupAvx2 &g, __m256 x) {
+    __m256 y = _mm256_fmadd_ps(g.c[2], g.h[1], _mm256_mul_ps(g.c[1], g.h[0]));
+    y = _mm256_fnmadd_ps(g.c[4], g.h[3], y);
+    y = _mm256_fnmadd_ps(g.c[3], g.h[2], y);
+    y = _mm256_fmadd_ps(g.c[0], x, y);
+    g.h[1] = g.h[0];
+    g.h[0] = x;
+    g.h[3] = g.h[2];
+    g.h[2] = y;
+    for (size_t k = 0; k < BIQUAD_COEFFICIENTS; ++k) {
+        g.c[k] = _mm256_add_ps(g.c[k], g.step[k]);
+    }
+    return y;
+}
+
+template <unsigned WAVES>
+__attribute__((target("avx2,fma")))
+static inline __m256 wave_mix_avx2(const Wavetables &tables, __m256i phase, __m256i level, const WaveMix &wave) {
+    const __m256i index = _mm256_srli_epi32(phase, WAVETABLE_FRAC_BITS);
+    const __m256i level_index = _mm256_add_epi32(index, level);
+    const __m256 frac = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(phase, _mm256_set1_epi32(WAVETABLE_FRAC_MASK))),
+                                      _mm256_set1_ps(WAVETABLE_FRAC_SCALE));
+    __m256 sample = _mm256_setzero_ps();
+    if constexpr ((WAVES & WAVE_SIN) != 0) {
+        sample = _mm256_mul_ps(_mm256_set1_ps(wave.sin), table_read_avx2(tables.sine.data(), index, frac));
+    }
+    if constexpr ((WAVES & WAVE_SAW) != 0) {
+        sample = _mm256_fmadd_ps(_mm256_set1_ps(wave.saw), table_read_avx2(tables.saw.data(), level_index, frac), sample);
+    }
+    if constexpr ((WAVES & WAVE_SQUARE) != 0) {
+        sample = _mm256_fmadd_ps(_mm256_set1_ps(wave.square), table_read_avx2(tables.square.data(), level_index, frac), sample);
+    }
+    return sample;
+}
+
+template <unsigned WAVES, bool STEREO, bool FILTER>
+__attribute__((target("avx2,fma")))
+static void render_avx2_into(float *out, float *out_right, unsigned long frames, const OscVoices &voices,
+                             const WaveMix &wave) {
+    const Wavetables &tables = get_wavetables();
+
+    for (size_t j = 0; j < voices.count; j += 8) {
+        const int live = static_cast<int>(std::min<size_t>(8, voices.count - j));
+        const __m256 live_mask = _mm256_castsi256_ps(
+                _mm256_cmpgt_epi32(_mm256_set1_epi32(live), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)));
+        alignas(32) int32_t levels[8];
+        for (int lane = 0; lane < 8; ++lane) {
+            levels[lane] = lane < live ? static_cast<int32_t>(wavetable_level(voices.phase_inc[j + lane]) * WAVETABLE_STRIDE) : 0;
+        }
+        const __m256i level = _mm256_load_si256(reinterpret_cast<const __m256i *>(levels));
+        __m256i phase = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(voices.phase + j));
+        const __m256i inc = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(voices.phase_inc + j));
+        const float *env = voices.env + j;
+        const float *env_right = STEREO ? voices.env_right + j : nullptr;
+        BiquadGroupAvx2 filter;
+        if constexpr (FILTER) {
+            biquad_load_avx2(filter, voices.filter, j);
+        }
+
+        for (unsigned long start = 0; start < frames;) {
+            const unsigned long end = FILTER ? std::min(frames, start + FILTER_RUN) : frames;
+            alignas(32) float raw[FILTER ? FILTER_RUN * 8 : 1];
+            if constexpr (FILTER) {
+                for (unsigned long i = start; i < end; ++i) {
+                    _mm256_store_ps(raw + (i - start) * 8, wave_mix_avx2<WAVES>(tables, phase, level, wave));
+                    phase = _mm256_add_epi32(phase, inc);
+                }
+            }
+            for (unsigned long i = start; i < end; ++i) {
+                const __m256 vol = _mm256_loadu_ps(env + i * voices.env_stride);
+                __m256 sample;
+                if constexpr (FILTER) {
+                    sample = biquad_avx2(filter, _mm256_and_ps(_mm256_load_ps(raw + (i - start) * 8), live_mask));
+                } else {
+                    sample = wave_mix_avx2<WAVES>(tables, phase, level, wave);
+                    phase = _mm256_add_epi32(phase, inc);
+                }
+                if constexpr (STEREO) {
+                    const __m256 vol_right = _mm256_loadu_ps(env_right + i * voices.env_stride);
+                    out_right[i] += horizontal_sum_avx2(_mm256_and_ps(_mm256_mul_ps(vol_right, sample), live_mask));
+                }
+                out[i] += horizontal_sum_avx2(_mm256_and_ps(_mm256_mul_ps(vol, sample), live_mask));
+            }
+            start = end;
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(voices.phase + j), phase);
+        if constexpr (FILTER) {
+            biquad_store_avx2(filter, voices.filter, j);
+        }
+    }
+}
+
+template <unsigned VARIANT>
+__attribute__((target("avx2,fma")))
+static void render_avx2(float *out, unsigned long frames, const OscVoices &voices, const WaveMix &wave) {
+    render_avx2_into<VARIANT & WAVE_ALL, false, (VARIANT & OSC_FILTERED) != 0>(out, nullptr, frames, voices, wave);
+}
+
+template <unsigned VARIANT>
+__attribute__((target("avx2,fma")))
+static void render_avx2_stereo(float *left, float *right, unsigned long frames, const OscVoices &voices,
+                               const WaveMix &wave) {
+    render_avx2_into<VARIANT & WAVE_ALL, true, (VARIANT & OSC_FILTERED) != 0>(left, right, frames, voices, wave);
+}
+
+#endif  // OSC_X86
+
+// one specialization per variant, indexed by its WaveBits mask (plus
+// OSC_FILTERED). Filtered ones always run, the filters ring out on silence.
+static const OscKernelTable SCALAR_KERNELS = {
+        advance_silent, render_scalar<1>, render_scalar<2>, render_scalar<3>,
+        render_scalar<4>, render_scalar<5>, render_scalar<6>, render_scalar<7>,
+        render_scalar<8>, render_scalar<9>, render_scalar<10>, render_scalar<11>,
+        render_scalar<12>, render_scalar<13>, render_scalar<14>, render_scalar<15>
+};
+static const StereoOscKernelTable SCALAR_STEREO_KERNELS = {
+        advance_silent_stereo, render_scalar_stereo<1>, render_scalar_stereo<2>, render_scalar_stereo<3>,
+        render_scalar_stereo<4>, render_scalar_stereo<5>, render_scalar_stereo<6>, render_scalar_stereo<7>,
+        render_scalar_stereo<8>, render_scalar_stereo<9>, render_scalar_stereo<10>, render_scalar_stereo<11>,
+        render_scalar_stereo<12>, render_scalar_stereo<13>, render_scalar_stereo<14>, render_scalar_stereo<15>
+};
+#ifdef OSC_X86
+static const OscKernelTable SSE41_KERNELS = {
+        advance_silent, render_sse41<1>, render_sse41<2>, render_sse41<3>,
+        render_sse41<4>, render_sse41<5>, render_sse41<6>, render_sse41<7>,
+        render_sse41<8>, render_sse41<9>, render_sse41<10>, render_sse41<11>,
+        render_sse41<12>, render_sse41<13>, render_sse41<14>, render_sse41<15>
+};
+static const StereoOscKernelTable SSE41_STEREO_KERNELS = {
+        advance_silent_stereo, render_sse41_stereo<1>, render_sse41_stereo<2>, render_sse41_stereo<3>,
+        render_sse41_stereo<4>, render_sse41_stereo<5>, render_sse41_stereo<6>, render_sse41_stereo<7>,
+        render_sse41_stereo<8>, render_sse41_stereo<9>, render_sse41_stereo<10>, render_sse41_stereo<11>,
+        render_sse41_stereo<12>, render_sse41_stereo<13>, render_sse41_stereo<14>, render_sse41_stereo<15>
+};
+static const OscKernelTable AVX2_KERNELS = {
+        advance_silent, render_avx2<1>, render_avx2<2>, render_avx2<3>,
+        render_avx2<4>, render_avx2<5>, render_avx2<6>, render_avx2<7>,
+        render_avx2<8>, render_avx2<9>, render_avx2<10>, render_avx2<11>,
+        render_avx2<12>, render_avx2<13>, render_avx2<14>, render_avx2<15>
+};
+static const StereoOscKernelTable AVX2_STEREO_KERNELS = {
+        advance_silent_stereo, render_avx2_stereo<1>, render_avx2_stereo<2>, render_avx2_stereo<3>,
+        render_avx2_stereo<4>, render_avx2_stereo<5>, render_avx2_stereo<6>, render_avx2_stereo<7>,
+        render_avx2_stereo<8>, render_avx2_stereo<9>, render_avx2_stereo<10>, render_avx2_stereo<11>,
+        render_avx2_stereo<12>, render_avx2_stereo<13>, render_avx2_stereo<14>, render_avx2_stereo<15>
+};
+#endif
+
+OscKernel get_oscillator_kernel(OscKernelType type, unsigned waves) {
+    const OscKernelTable *table = get_oscillator_kernels(type);
+    return table ? (*table)[waves & (WAVE_ALL | OSC_FILTERED)] : nullptr;
+}
+
+const OscKernelTable *get_oscillator_kernels(OscKernelType type) {
+    switch (type) {
+        case OSC_SCALAR:
+            return &SCALAR_KERNELS;
+#ifdef OSC_X86
+        case OSC_SSE41:
+            return __builtin_cpu_supports("sse4.1") ? &SSE41_KERNELS : nullptr;
+        case OSC_AVX2:
+            return (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) ? &AVX2_KERNELS : nullptr;
+#endif
+        default:
+            return nullptr;
+    }
+}
+
+const StereoOscKernelTable *get_stereo_oscillator_kernels(OscKernelType type) {
+    // available exactly when the mono table is
+    if (get_oscillator_kernels(type) == nullptr) {
+        return nullptr;
+    }
+    switch (type) {
+        case OSC_SCALAR:
+            return &SCALAR_STEREO_KERNELS;
+#ifdef OSC_X86
+        case OSC_SSE41:
+            return &SSE41_STEREO_KERNELS;
+        case OSC_AVX2:
+            return &AVX2_STEREO_KERNELS;
+#endif
+        default:
+            return nullptr;
+    }
+}
+
+const char *oscillator_kernel_name(OscKernelType type) {
+    switch (type) {
+        case OSC_SCALAR: return "scalar";
+        case OSC_SSE41: return "sse4.1";
+        case OSC_AVX2: return "avx2";
+    }
+    return "unknown";
+}
+
+// filter lanes for the accuracy check, a copy per kernel run
+struct TestFilters {
+    std::array<float, 16> coefficient[BIQUAD_COEFFICIENTS], step[BIQUAD_COEFFICIENTS], history[BIQUAD_HISTORY];
+
+    BiquadLanes lanes() {
+        BiquadLanes lanes;
+        for (size_t k = 0; k < BIQUAD_COEFFICIENTS; ++k) {
+            lanes.coefficient[k] = coefficient[k].data();
+            lanes.step[k] = step[k].data();
+        }
+        for (size_t k = 0; k < BIQUAD_HISTORY; ++k) {
+            lanes.history[k] = history[k].data();
+        }
+        return lanes;
+    }
+};
+
+float oscillator_kernel_error(OscKernelType type) {
+    if (get_oscillator_kernels(type) == nullptr) {
+        return -1;
+    }
+
+    // 13 voices so the SIMD kernels also exercise a partial lane group,
+    // spread across the mip levels with rising, falling and flat envelopes.
+    // Every specialization is checked against the full scalar kernel with the
+    // weights of the waveforms it skips set to zero, phases included. Filtered
+    // ones sweep each voice's cutoff somewhere different, from some history.
+    constexpr size_t VOICES = 13;
+    constexpr size_t STRIDE = 16;
+    constexpr unsigned long FRAMES = 512;
+    static std::array<float, FRAMES * STRIDE> env, env_right;
+    for (unsigned long i = 0; i < FRAMES; ++i) {
+        for (size_t j = 0; j < VOICES; ++j) {
+            float slope = (j % 3 == 0) ? 1e-3f : (j % 3 == 1) ? -1e-3f : 0.0f;
+            env[i * STRIDE + j] = std::clamp(0.05f * j + slope * i, 0.0f, 0.5f);
+            env_right[i * STRIDE + j] = 0.5f - env[i * STRIDE + j];
+        }
+    }
+    TestFilters filters = {};
+    for (size_t j = 0; j < VOICES; ++j) {
+        BiquadCoefficients from = lowpass_coefficients(0.02f + 0.2f * j, 0.7f);
+        BiquadCoefficients to = lowpass_coefficients(2.5f - 0.15f * j, 0.5f + 0.3f * j);
+        const float start[BIQUAD_COEFFICIENTS] = {from.b0, from.b1, from.b2, from.a1, from.a2};
+        const float end[BIQUAD_COEFFICIENTS] = {to.b0, to.b1, to.b2, to.a1, to.a2};
+        for (size_t k = 0; k < BIQUAD_COEFFICIENTS; ++k) {
+            filters.coefficient[k][j] = start[k];
+            filters.step[k][j] = (end[k] - start[k]) / FRAMES;
+        }
+        for (size_t k = 0; k < BIQUAD_HISTORY; ++k) {
+            filters.history[k][j] = 0.1f * static_cast<float>(k + 1) - 0.02f * j;
+        }
+    }
+    const OscKernelTable &scalar = SCALAR_KERNELS;
+    float error = 0;
+    for (unsigned variant = 0; variant < OSC_KERNEL_VARIANTS; ++variant) {
+        const unsigned waves = variant & WAVE_ALL;
+        const unsigned reference = WAVE_ALL | (variant & OSC_FILTERED);
+        // a and b for the mono kernels, c and d for the stereo one and its reference
+        std::array<uint32_t, 16> phase_a = {}, phase_b = {}, phase_c = {}, phase_d = {}, inc = {};
+        for (size_t j = 0; j < VOICES; ++j) {
+            phase_a[j] = phase_b[j] = phase_c[j] = phase_d[j] = static_cast<uint32_t>(j * 0x13579BDu);
+            inc[j] = uint32_t(1) << (18 + j);
+        }
+        TestFilters filter_a = filters, filter_b = filters, filter_c = filters, filter_d = filters;
+        const WaveMix wave = {
+                .sin = (waves & WAVE_SIN) ? 0.4f : 0.0f,
+                .saw = (waves & WAVE_SAW) ? 0.3f : 0.0f,
+                .square = (waves & WAVE_SQUARE) ? 0.3f : 0.0f
+        };
+        std::array<float, FRAMES> out_a = {}, out_b = {}, left = {}, right = {}, right_ref = {};
+
+        scalar[reference](out_a.data(), FRAMES,
+                          {phase_a.data(), inc.data(), env.data(), STRIDE, VOICES, nullptr, filter_a.lanes()}, wave);
+        get_oscillator_kernel(type, variant)(out_b.data(), FRAMES,
+                                             {phase_b.data(), inc.data(), env.data(), STRIDE, VOICES, nullptr,
+                                              filter_b.lanes()}, wave);
+
+        // the stereo kernel has to give the mono result on the left and the
+        // env_right one on the right
+        OscVoices stereo = {phase_c.data(), inc.data(), env.data(), STRIDE, VOICES, env_right.data(), filter_c.lanes()};
+        (*get_stereo_oscillator_kernels(type))[variant](left.data(), right.data(), FRAMES, stereo, wave);
+        scalar[reference](right_ref.data(), FRAMES,
+                          {phase_d.data(), inc.data(), env_right.data(), STRIDE, VOICES, nullptr, filter_d.lanes()},
+                          wave);
+
+        for (unsigned long i = 0; i < FRAMES; ++i) {
+            error = std::max(error, std::fabs(out_a[i] - out_b[i]));
+            error = std::max(error, std::fabs(out_a[i] - left[i]));
+            error = std::max(error, std::fabs(right_ref[i] - right[i]));
+        }
+        for (size_t j = 0; j < VOICES; ++j) {
+            if (phase_a[j] != phase_b[j] || phase_a[j] != phase_c[j]) {
+                error = std::max(error, 1.0f);
+            }
+        }
+        // the lanes past the last voice have to come out as silent as they went in
+        for (size_t j = VOICES; j < STRIDE; ++j) {
+            for (size_t k = 0; k < BIQUAD_HISTORY; ++k) {
+                if (filter_b.history[k][j] != 0 || filter_c.history[k][j] != 0) {
+                    error = std::max(error, 1.0f);
+                }
+            }
+        }
+    }
+    return error;
+}
+
+OscKernelType select_oscillator_kernel() {
+    get_wavetables();
+    for (OscKernelType type : {OSC_AVX2, OSC_SSE41}) {
+        float error = oscillator_kernel_error(type);
+        if (error < 0) {
+            continue;
+        }
+        if (error > KERNEL_TOLERANCE) {
+            spdlog::warn("{} oscillator kernel off by {} from scalar, not using it", oscillator_kernel_name(type), error);
+            continue;
+        }
+        spdlog::info("using {} oscillator kernel (max error {})", oscillator_kernel_name(type), error);
+        return type;
+    }
+    spdlog::info("using scalar oscillator kernel");
+    return OSC_SCALAR;
+}
@@ -0,0 +1,95 @@
+#ifndef OSCILLATOR_KERNEL_H
+#define OSCILLATOR_KERNEL_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include "Biquad.h"
+
+enum OscKernelType {
+    OSC_SCALAR, OSC_SSE41, OSC_AVX2
+};
+
+// The oscillator state of a run of voices, laid out as in VoicePool.
+// Phases and increments are 32 bit fixed point cycles, see Wavetable.h.
+// Envelope levels come pre-rendered (see EnvelopeGenerator.h): voice j's level
+// at frame i is env[i * env_stride + j].
+// The SIMD kernels work on groups of 8 voices, so every array (and every env
+// row) must be readable and writable up to count rounded up to a multiple of 8.
+// Stereo kernels also take env_right, laid out like env, and give each voice
+// env levels on the left and env_right levels on the right.
+// Filtered kernels also run every voice through its own low-pass lane of
+// filter (laid out like phase, and read and written as far) between the
+// waveform and the envelope, and write the lanes' state back.
+struct OscVoices {
+    uint32_t *phase;
+    const uint32_t *phase_inc;
+    const float *env;
+    size_t env_stride;
+    size_t count;
+    const float *env_right = nullptr;
+    BiquadLanes filter = {};
+};
+
+struct WaveMix {
+    float sin;
+    float saw;
+    float square;
+};
+
+// Kernels are specialized at compile time on which waveforms they evaluate,
+// so a patch that only uses one of them never reads the other tables
+enum WaveBits {
+    WAVE_SIN = 1, WAVE_SAW = 2, WAVE_SQUARE = 4, WAVE_ALL = 7
+};
+constexpr size_t WAVE_MASKS = 8;
+// on top of the WaveBits, picks the filtered kernels
+constexpr unsigned OSC_FILTERED = 8;
+constexpr size_t OSC_KERNEL_VARIANTS = 2 * WAVE_MASKS;
+
+// the waveforms with a non-zero weight
+inline unsigned wave_mask(const WaveMix &wave) {
+    return (wave.sin != 0 ? WAVE_SIN : 0) | (wave.saw != 0 ? WAVE_SAW : 0) | (wave.square != 0 ? WAVE_SQUARE : 0);
+}
+
+// Advances every voice by frames samples and adds the sine/saw/square mix of
+// all of them, scaled by their envelopes and read from the band-limited
+// wavetables, into out[0, frames). Phases are written back.
+using OscKernel = void (*)(float *out, unsigned long frames, const OscVoices &voices, const WaveMix &wave);
+
+// Dispatch table of every specialization of one kernel type, indexed by
+// WaveBits mask, plus OSC_FILTERED for the filtered ones. Entry 0 only
+// advances phases; entry OSC_FILTERED also rings the filters out on silence.
+using OscKernelTable = std::array<OscKernel, OSC_KERNEL_VARIANTS>;
+
+// The same into left and right at once. Each voice's waveform is evaluated
+// once and only the envelope scaling and lane sum are done per side, so this
+// costs far less than two mono passes.
+using StereoOscKernel = void (*)(float *left, float *right, unsigned long frames, const OscVoices &voices,
+                                 const WaveMix &wave);
+using StereoOscKernelTable = std::array<StereoOscKernel, OSC_KERNEL_VARIANTS>;
+
+// nullptr if this CPU (or build) can't run the requested kernel. The kernel
+// only evaluates the waveforms in waves and ignores the other weights;
+// waves may include OSC_FILTERED.
+OscKernel get_oscillator_kernel(OscKernelType type, unsigned waves = WAVE_ALL);
+const OscKernelTable *get_oscillator_kernels(OscKernelType type);
+const StereoOscKernelTable *get_stereo_oscillator_kernels(OscKernelType type);
+
+const char *oscillator_kernel_name(OscKernelType type);
+
+// all kernels do the same table reads, only the rounding of the interpolation
+// and the lane summing order differ
+constexpr float KERNEL_TOLERANCE = 1e-4f;
+
+// Largest per-sample difference between any specialization (mono or stereo,
+// filtered or not) of the given kernel and the scalar kernel on a synthetic
+// voice load, or a negative value if it isn't available
+float oscillator_kernel_error(OscKernelType type);
+
+// Builds the wavetables and picks the widest kernel the CPU supports that also
+// passes the accuracy check against the scalar kernel. Call once, outside the
+// audio callback.
+OscKernelType select_oscillator_kernel();
+
+#endif  // OSCILLATOR_KERNEL_H
@@ -0,0 +1,87 @@
+#include "ParamRegistry.h"
+#include <cstdlib>
+
+static_assert(PARAM_COUNT <= 32, "ParamSet::dirty has a bit per parameter");
+
+// indexed by ParamId
+static const ParamInfo PARAMS[PARAM_COUNT] = {
+        {"attack", 1, 1000, 50},
+        {"decay", 1, 1000, 50},
+        {"sustain", 0, 1, 0.5},
+        {"release", 1, 1000, 50},
+        {"vol_lfo_frequency", 0.0001, 0.01, 0.008},
+        {"vol_lfo_amplitude", 0, 1, 0.2},
+        {"cutoff_lfo_frequency", 0.0001, 0.01, 0.008},
+        {"cutoff_lfo_amplitude", 0, 1, 0.2},
+        {"sin", 0, 1, 0.5},
+        {"saw", 0, 1, 0.5},
+        {"square", 0, 1, 0.5},
+        {"cutoff", 0.01, 20, 5},
+        {"Q", 0.1, 5, 0.5},
+        {"filter_bypass", 0, 1, 0},
+        {"delay_time", 1, 1000, 350},
+        {"delay_feedback", 0, 0.95, 0.4},
+        {"delay_mix", 0, 1, 0},
+        {"reverb_time", 100, 10000, 2000},
+        {"reverb_damping", 0, 1, 0.3},
+        {"reverb_mix", 0, 1, 0},
+        {"unison_voices", 1, 16, 1},
+        {"unison_detune", 0, 100, 20},
+        {"unison_spread", 0, 1, 0.5},
+        {"filter_key_track", 0, 1, 0},
+        {"filter_velocity", 0, 1, 0},
+};
+
+const ParamInfo &param_info(ParamId id) {
+    return PARAMS[id];
+}
+
+bool find_param(const std::string &name, ParamId &id) {
+    char *end;
+    long number = std::strtol(name.c_str(), &end, 10);
+    if (!name.empty() && *end == 0) {
+        if (number < 0 || number >= PARAM_COUNT) {
+            return false;
+        }
+        id = static_cast<ParamId>(number);
+        return true;
+    }
+    for (int i = 0; i < PARAM_COUNT; ++i) {
+        if (name == PARAMS[i].name) {
+            id = static_cast<ParamId>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+ParamSet::ParamSet() {
+    for (int i = 0; i < PARAM_COUNT; ++i) {
+        values[i] = PARAMS[i].default_value;
+    }
+}
+
+bool ParamSet::set(ParamId id, float value) {
+    value = clamp_param(id, value);
+    if (value == values[id]) {
+        return false;
+    }
+    values[id] = value;
+    dirty |= 1u << id;
+    return true;
+}
+
+void ParamSet::assign(ParamId id, float value) {
+    values[id] = clamp_param(id, value);
+}
+
+size_t ParamSet::take_changes(std::array<ParamChange, PARAM_COUNT> &changes) {
+    size_t count = 0;
+    for (int i = 0; i < PARAM_COUNT; ++i) {
+        if (dirty & (1u << i)) {
+            changes[count++] = {static_cast<ParamId>(i), values[i]};
+        }
+    }
+    dirty = 0;
+    return count;
+}
@@ -0,0 +1,97 @@
+#ifndef PARAM_REGISTRY_H
+#define PARAM_REGISTRY_H
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Every patch parameter under one stable ID. The IDs are what patch banks,
+// OSC automation (/synth/param) and render scripts (param) use, so they are
+// never renumbered: new parameters go on the end. They are also the fields
+// of a patch record, in file order (see PatchBank.h).
+enum ParamId : uint16_t {
+    PARAM_ATTACK = 0,
+    PARAM_DECAY = 1,
+    PARAM_SUSTAIN = 2,
+    PARAM_RELEASE = 3,
+    PARAM_VOL_LFO_FREQUENCY = 4,
+    PARAM_VOL_LFO_AMPLITUDE = 5,
+    PARAM_CUTOFF_LFO_FREQUENCY = 6,
+    PARAM_CUTOFF_LFO_AMPLITUDE = 7,
+    PARAM_SIN = 8,
+    PARAM_SAW = 9,
+    PARAM_SQUARE = 10,
+    PARAM_CUTOFF = 11,
+    PARAM_Q = 12,
+    PARAM_FILTER_BYPASS = 13,  // 0 or 1
+    PARAM_DELAY_TIME = 14,
+    PARAM_DELAY_FEEDBACK = 15,
+    PARAM_DELAY_MIX = 16,  // 0 takes the delay out
+    PARAM_REVERB_TIME = 17,
+    PARAM_REVERB_DAMPING = 18,
+    PARAM_REVERB_MIX = 19,  // 0 takes the reverb out
+    PARAM_UNISON_VOICES = 20,  // oscillators per voice, whole numbers 1..MAX_UNISON
+    PARAM_UNISON_DETUNE = 21,  // cents between the outermost oscillator and the note
+    PARAM_UNISON_SPREAD = 22,  // stereo width of the stack, 0 keeps it centered
+    PARAM_FILTER_KEY_TRACK = 23,  // 1 moves the cutoff with the note's pitch, 0 keeps it fixed
+    PARAM_FILTER_VELOCITY = 24,   // how far soft notes close the filter, 0 ignores velocity
+    PARAM_COUNT
+};
+
+// Units are the ones the set_* functions take (ms, kHz, 0..1)
+struct ParamInfo {
+    const char *name;
+    float min;
+    float max;
+    float default_value;
+};
+
+const ParamInfo &param_info(ParamId id);
+
+// ID of the parameter called name (as in ParamInfo), or its number.
+// Returns false if there is no such parameter.
+bool find_param(const std::string &name, ParamId &id);
+
+// value limited to id's range. Anything that isn't a finite number (a bad
+// patch, OSC message or script line) becomes the default, NaN would otherwise
+// get through the comparisons and stick in the filter for good.
+inline float clamp_param(ParamId id, float value) {
+    const ParamInfo &info = param_info(id);
+    if (!std::isfinite(value)) {
+        return info.default_value;
+    }
+    return value < info.min ? info.min : value > info.max ? info.max : value;
+}
+
+struct ParamChange {
+    ParamId id;
+    float value;
+};
+
+// A control thread's view of one engine's parameters. Edits only mark their
+// parameter dirty; take_changes() collects everything edited since the last
+// call, once per parameter however often it moved, so the owner can publish
+// at its own pace instead of on every edit.
+struct ParamSet {
+    std::array<float, PARAM_COUNT> values;
+    uint32_t dirty = 0;  // bit per ParamId
+
+    ParamSet();
+
+    // clamps to the parameter's range, returns false if that didn't change anything
+    bool set(ParamId id, float value);
+
+    // a value the engine already has (a loaded patch), doesn't mark it dirty
+    void assign(ParamId id, float value);
+
+    float get(ParamId id) const {
+        return values[id];
+    }
+
+    // writes the dirty parameters to changes in ID order, clears them and returns how many
+    size_t take_changes(std::array<ParamChange, PARAM_COUNT> &changes);
+};
+
+#endif  // PARAM_REGISTRY_H
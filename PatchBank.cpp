@@ -0,0 +1,196 @@
+#include "PatchBank.h"
+#include <spdlog/spdlog.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+constexpr char BANK_MAGIC[8] = {'S', 'Y', 'N', 'T', 'H', 'B', 'N', 'K'};
+constexpr size_t HEADER_SIZE = 16;
+// the floats are the parameters before PARAM_FILTER_BYPASS, which is a flag,
+// then (from version 2) the ones after it, each version appending its own
+constexpr size_t FLOAT_FIELDS = PARAM_FILTER_BYPASS;
+constexpr size_t APPENDED_FLOAT_FIELDS = PARAM_COUNT - PARAM_FILTER_BYPASS - 1;
+constexpr size_t RECORD_V1_SIZE = PATCH_NAME_LENGTH + FLOAT_FIELDS * 4 + 4;
+constexpr size_t RECORD_SIZE = RECORD_V1_SIZE + APPENDED_FLOAT_FIELDS * 4;
+static_assert(RECORD_SIZE == 124, "a new parameter needs a new bank version");
+constexpr uint32_t FLAG_FILTER_BYPASS = 1;
+
+static uint16_t read_u16(const unsigned char *p) {
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+static uint32_t read_u32(const unsigned char *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+static void put_u16(std::vector<unsigned char> &out, uint16_t value) {
+    out.push_back(value & 0xff);
+    out.push_back(value >> 8);
+}
+
+static void put_u32(std::vector<unsigned char> &out, uint32_t value) {
+    for (int b = 0; b < 4; ++b) {
+        out.push_back((value >> (8 * b)) & 0xff);
+    }
+}
+
+// the float fields by ParamId (skipping PARAM_FILTER_BYPASS), which is also their file order
+static float *patch_floats(Patch &patch, size_t i) {
+    float *fields[FLOAT_FIELDS + APPENDED_FLOAT_FIELDS] = {
+            &patch.attack, &patch.decay, &patch.sustain, &patch.release,
+            &patch.vol_lfo_frequency, &patch.vol_lfo_amplitude,
+            &patch.cutoff_lfo_frequency, &patch.cutoff_lfo_amplitude,
+            &patch.sin, &patch.saw, &patch.square,
+            &patch.cutoff, &patch.Q,
+            &patch.delay_time, &patch.delay_feedback, &patch.delay_mix,
+            &patch.reverb_time, &patch.reverb_damping, &patch.reverb_mix,
+            &patch.unison_voices, &patch.unison_detune, &patch.unison_spread,
+            &patch.filter_key_track, &patch.filter_velocity
+    };
+    return fields[i];
+}
+
+static float *patch_param_field(Patch &patch, ParamId id) {
+    return patch_floats(patch, id < PARAM_FILTER_BYPASS ? id : id - 1);
+}
+
+float get_patch_param(const Patch &patch, ParamId id) {
+    if (id == PARAM_FILTER_BYPASS) {
+        return patch.filter_bypass ? 1.0f : 0.0f;
+    }
+    return *patch_param_field(const_cast<Patch &>(patch), id);
+}
+
+void set_patch_param(Patch &patch, ParamId id, float value) {
+    if (id == PARAM_FILTER_BYPASS) {
+        patch.filter_bypass = value >= 0.5f;
+    } else {
+        *patch_param_field(patch, id) = value;
+    }
+}
+
+bool open_patch_bank(const char *path, PatchBank &bank) {
+    close_patch_bank(bank);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        spdlog::error("could not open patch bank {}: {}", path, std::strerror(errno));
+        return false;
+    }
+    struct stat st = {};
+    if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(HEADER_SIZE)) {
+        spdlog::error("{} is too short to be a patch bank", path);
+        close(fd);
+        return false;
+    }
+    void *mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);  // the mapping keeps the file alive
+    if (mapped == MAP_FAILED) {
+        spdlog::error("could not map patch bank {}: {}", path, std::strerror(errno));
+        return false;
+    }
+
+    const unsigned char *data = static_cast<const unsigned char *>(mapped);
+    size_t size = static_cast<size_t>(st.st_size);
+    uint16_t version = read_u16(data + 8);
+    size_t record_size = read_u16(data + 10);
+    size_t count = read_u32(data + 12);
+    const char *problem = nullptr;
+    if (std::memcmp(data, BANK_MAGIC, sizeof(BANK_MAGIC)) != 0) {
+        problem = "not a patch bank";
+    } else if (version == 0 || record_size < RECORD_V1_SIZE) {
+        problem = "unsupported version";
+    } else if (count > (size - HEADER_SIZE) / record_size) {
+        problem = "truncated";
+    }
+    if (problem != nullptr) {
+        spdlog::error("{}: {}", path, problem);
+        munmap(mapped, size);
+        return false;
+    }
+
+    // browsing jumps around, don't bother reading ahead
+    madvise(mapped, size, MADV_RANDOM);
+    bank.data = data;
+    bank.size = size;
+    bank.count = count;
+    bank.record_size = record_size;
+    bank.version = version;
+    spdlog::info("patch bank {}: {} patches, version {}", path, count, version);
+    return true;
+}
+
+void close_patch_bank(PatchBank &bank) {
+    if (bank.data != nullptr) {
+        munmap(const_cast<unsigned char *>(bank.data), bank.size);
+    }
+    bank = PatchBank();
+}
+
+bool read_patch(const PatchBank &bank, size_t index, Patch &patch) {
+    if (index >= bank.count) {
+        return false;
+    }
+    const unsigned char *p = bank.data + HEADER_SIZE + index * bank.record_size;
+    std::memcpy(patch.name, p, PATCH_NAME_LENGTH);
+    p += PATCH_NAME_LENGTH;
+    for (size_t i = 0; i < FLOAT_FIELDS; ++i, p += 4) {
+        uint32_t bits = read_u32(p);
+        std::memcpy(patch_floats(patch, i), &bits, 4);
+    }
+    uint32_t flags = read_u32(p);
+    patch.filter_bypass = (flags & FLAG_FILTER_BYPASS) != 0;
+    p += 4;
+    for (size_t i = 0; i < APPENDED_FLOAT_FIELDS; ++i, p += 4) {
+        float *field = patch_floats(patch, FLOAT_FIELDS + i);
+        if (bank.record_size >= RECORD_V1_SIZE + (i + 1) * 4) {
+            uint32_t bits = read_u32(p);
+            std::memcpy(field, &bits, 4);
+        } else {
+            *field = param_info(static_cast<ParamId>(PARAM_FILTER_BYPASS + 1 + i)).default_value;
+        }
+    }
+    return true;
+}
+
+bool write_patch_bank(const char *path, const std::vector<Patch> &patches) {
+    std::vector<unsigned char> out;
+    out.reserve(HEADER_SIZE + patches.size() * RECORD_SIZE);
+    out.insert(out.end(), BANK_MAGIC, BANK_MAGIC + sizeof(BANK_MAGIC));
+    put_u16(out, PATCH_BANK_VERSION);
+    put_u16(out, RECORD_SIZE);
+    put_u32(out, static_cast<uint32_t>(patches.size()));
+    for (Patch patch : patches) {
+        out.insert(out.end(), patch.name, patch.name + PATCH_NAME_LENGTH);
+        for (size_t i = 0; i < FLOAT_FIELDS; ++i) {
+            uint32_t bits;
+            std::memcpy(&bits, patch_floats(patch, i), 4);
+            put_u32(out, bits);
+        }
+        put_u32(out, patch.filter_bypass ? FLAG_FILTER_BYPASS : 0);
+        for (size_t i = 0; i < APPENDED_FLOAT_FIELDS; ++i) {
+            uint32_t bits;
+            std::memcpy(&bits, patch_floats(patch, FLOAT_FIELDS + i), 4);
+            put_u32(out, bits);
+        }
+    }
+
+    std::string temp = std::string(path) + ".tmp";
+    FILE *file = std::fopen(temp.c_str(), "wb");
+    if (file == nullptr) {
+        spdlog::error("could not write patch bank {}: {}", temp, std::strerror(errno));
+        return false;
+    }
+    bool ok = std::fwrite(out.data(), 1, out.size(), file) == out.size();
+    ok = std::fclose(file) == 0 && ok;
+    if (!ok || std::rename(temp.c_str(), path) != 0) {
+        spdlog::error("could not write patch bank {}: {}", path, std::strerror(errno));
+        std::remove(temp.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,69 @@
+#ifndef PATCH_BANK_H
+#define PATCH_BANK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "ParamRegistry.h"
+
+// Everything that makes up a sound, in the units the set_* functions take.
+// Waveform weights are the normalized ones the engine plays.
+constexpr size_t PATCH_NAME_LENGTH = 24;
+
+struct Patch {
+    char name[PATCH_NAME_LENGTH];  // null padded, not always null terminated
+    float attack, decay, sustain, release;
+    float vol_lfo_frequency, vol_lfo_amplitude;
+    float cutoff_lfo_frequency, cutoff_lfo_amplitude;
+    float sin, saw, square;
+    float cutoff, Q;
+    bool filter_bypass;
+    float delay_time, delay_feedback, delay_mix;
+    float reverb_time, reverb_damping, reverb_mix;
+    float unison_voices, unison_detune, unison_spread;
+    float filter_key_track, filter_velocity;
+};
+
+// Bank file, all little endian:
+//
+//   header   "SYNTHBNK", u16 version, u16 record size, u32 patch count
+//   records  patch count fixed size records, back to back
+//
+// Version 1 records are the name followed by the Patch floats in ParamId
+// order and a u32 of flags (bit 0 filter bypass), 80 bytes. Version 2 appends
+// the delay and reverb floats, again in ParamId order, 104 bytes, version 3
+// the unison ones, 116 bytes, and version 4 filter key tracking and velocity,
+// 124 bytes. Fields a record is too short for get the registry defaults
+// (effects off, a single oscillator, one filter for all voices). Later
+// versions only ever append fields, so a reader takes the prefix it knows
+// from any record at least that long and skips the rest.
+constexpr uint16_t PATCH_BANK_VERSION = 4;
+
+// A bank file mapped read only. Patches are decoded on demand, so opening a
+// bank of thousands costs the same as one and browsing only touches the
+// pages it reads.
+struct PatchBank {
+    const unsigned char *data = nullptr;
+    size_t size = 0;
+    size_t count = 0;
+    size_t record_size = 0;
+    uint16_t version = 0;
+};
+
+// a patch's parameters by registry ID, filter_bypass reads as 0 or 1
+float get_patch_param(const Patch &patch, ParamId id);
+void set_patch_param(Patch &patch, ParamId id, float value);
+
+// false (and logs why) if the file can't be mapped or isn't a bank.
+// Closes whatever bank was open before.
+bool open_patch_bank(const char *path, PatchBank &bank);
+void close_patch_bank(PatchBank &bank);
+
+// false if index is out of range
+bool read_patch(const PatchBank &bank, size_t index, Patch &patch);
+
+// Writes a version PATCH_BANK_VERSION bank next to path and renames it into
+// place, so a bank that is mapped (here or elsewhere) is never seen half written
+bool write_patch_bank(const char *path, const std::vector<Patch> &patches);
+
+#endif  // PATCH_BANK_H
@@ -0,0 +1,190 @@
+#include "RenderScript.h"
+#include "AudioEngine.h"
+#include "PatchBank.h"
+#include "ParamRegistry.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <spdlog/spdlog.h>
+
+struct CommandSpec {
+    const char *name;
+    ScriptCommand command;
+    int arg_count;
+};
+
+static const CommandSpec COMMANDS[] = {
+        {"note_on", CMD_NOTE_ON, 2},
+        {"note_off", CMD_NOTE_OFF, 1},
+        {"envelope", CMD_ENVELOPE, 4},
+        {"lfo", CMD_LFO, 2},
+        {"cutoff_lfo", CMD_CUTOFF_LFO, 2},
+        {"waveform", CMD_WAVEFORM, 3},
+        {"filter", CMD_FILTER, 2},
+        {"key_freq", CMD_KEY_FREQ, 2},
+        {"polyphony", CMD_POLYPHONY, 2},
+        {"oversampling", CMD_OVERSAMPLING, 1},
+        {"filter_bypass", CMD_FILTER_BYPASS, 1},
+        {"program", CMD_PROGRAM, 1},
+        {"param", CMD_PARAM, 2},
+        {"delay", CMD_DELAY, 3},
+        {"reverb", CMD_REVERB, 3},
+        {"unison", CMD_UNISON, 3},
+        {"filter_tracking", CMD_FILTER_TRACKING, 2},
+};
+
+bool load_script(const std::string &path, std::vector<ScriptEvent> &events) {
+    std::ifstream file(path);
+    if (!file) {
+        spdlog::error("could not open script {}", path);
+        return false;
+    }
+
+    std::string line;
+    int line_number = 0;
+    unsigned part = 0;
+    while (std::getline(file, line)) {
+        ++line_number;
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        ScriptEvent event = {};
+        event.part = part;
+        std::string name;
+        if (!(fields >> event.time)) {
+            std::string rest;
+            std::istringstream directive(line);
+            if (directive >> rest) {
+                if (rest == "part" && directive >> part && part < MAX_SCRIPT_PARTS) {
+                    continue;
+                }
+                spdlog::error("{}:{}: expected a time in ms or part <0..{}>", path, line_number, MAX_SCRIPT_PARTS - 1);
+                return false;
+            }
+            continue;  // blank or comment line
+        }
+        if (!(fields >> name)) {
+            spdlog::error("{}:{}: missing command", path, line_number);
+            return false;
+        }
+
+        const CommandSpec *spec = nullptr;
+        for (const CommandSpec &candidate : COMMANDS) {
+            if (name == candidate.name) {
+                spec = &candidate;
+            }
+        }
+        if (spec == nullptr) {
+            spdlog::error("{}:{}: unknown command '{}'", path, line_number, name);
+            return false;
+        }
+        event.command = spec->command;
+        int first_arg = 0;
+        if (spec->command == CMD_PARAM) {
+            // the parameter goes by name or ID
+            std::string param;
+            ParamId id;
+            if (!(fields >> param) || !find_param(param, id)) {
+                spdlog::error("{}:{}: unknown parameter '{}'", path, line_number, param);
+                return false;
+            }
+            event.args[0] = id;
+            first_arg = 1;
+        }
+        for (int i = first_arg; i < spec->arg_count; ++i) {
+            if (!(fields >> event.args[i])) {
+                spdlog::error("{}:{}: {} takes {} arguments", path, line_number, name, spec->arg_count);
+                return false;
+            }
+        }
+        if (event.time < 0) {
+            spdlog::error("{}:{}: negative time", path, line_number);
+            return false;
+        }
+        events.push_back(event);
+    }
+
+    std::stable_sort(events.begin(), events.end(),
+                     [](const ScriptEvent &a, const ScriptEvent &b) { return a.time < b.time; });
+    return true;
+}
+
+static unsigned short key_arg(float value) {
+    return static_cast<unsigned short>(std::clamp(static_cast<int>(value), 0, 255));
+}
+
+void apply_script_event(const ScriptEvent &event, SynthEngine &engine, std::array<float, 256> &key_map,
+                        const PatchBank &bank, uint64_t frame) {
+    const std::array<float, 4> &a = event.args;
+    switch (event.command) {
+        case CMD_NOTE_ON:
+            engine.note_on_at(key_arg(a[0]), static_cast<unsigned short>(a[1]), frame);
+            break;
+        case CMD_NOTE_OFF:
+            engine.note_off_at(key_arg(a[0]), frame);
+            break;
+        case CMD_ENVELOPE:
+            engine.set_envelope(a[0], a[1], a[2], a[3]);
+            break;
+        case CMD_LFO:
+            engine.set_LFO(a[0], a[1]);
+            break;
+        case CMD_CUTOFF_LFO:
+            engine.set_cutoff_lfo(a[0], a[1]);
+            break;
+        case CMD_WAVEFORM:
+            engine.set_waveform(a[0], a[1], a[2]);
+            break;
+        case CMD_FILTER:
+            engine.set_filter(a[0], a[1]);
+            break;
+        case CMD_KEY_FREQ:
+            key_map[key_arg(a[0])] = a[1];
+            engine.set_key_freq_map(key_map);
+            break;
+        case CMD_POLYPHONY:
+            engine.set_polyphony(static_cast<unsigned>(std::max(1.0f, a[0])),
+                                 static_cast<StealPolicy>(std::clamp(static_cast<int>(a[1]), 0, 2)));
+            break;
+        case CMD_OVERSAMPLING:
+            engine.set_oversampling(static_cast<unsigned>(std::max(1.0f, a[0])));
+            break;
+        case CMD_DELAY:
+            engine.set_delay(a[0], a[1], a[2]);
+            break;
+        case CMD_REVERB:
+            engine.set_reverb(a[0], a[1], a[2]);
+            break;
+        case CMD_UNISON:
+            engine.set_unison(static_cast<unsigned>(std::max(1.0f, a[0])), a[1], a[2]);
+            break;
+        case CMD_FILTER_BYPASS:
+            engine.set_filter_bypass(a[0] != 0);
+            break;
+        case CMD_FILTER_TRACKING:
+            engine.set_filter_tracking(a[0], a[1]);
+            break;
+        case CMD_PARAM: {
+            ParamChange change = {static_cast<ParamId>(a[0]), a[1]};
+            engine.set_params({&change, 1});
+            break;
+        }
+        case CMD_PROGRAM: {
+            Patch patch;
+            if (read_patch(bank, static_cast<size_t>(std::max(0.0f, a[0])), patch)) {
+                engine.load_patch(patch);
+            } else {
+                spdlog::warn("no patch {} in the bank, program change skipped", a[0]);
+            }
+            break;
+        }
+    }
+}
+
+std::array<float, 256> default_key_map() {
+    std::array<float, 256> map = {};
+    for (int key = 0; key < 256; ++key) {
+        map[key] = 0.44f * std::pow(2.0f, (key - 69) / 12.0f);
+    }
+    return map;
+}
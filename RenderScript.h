@@ -0,0 +1,72 @@
+#ifndef RENDER_SCRIPT_H
+#define RENDER_SCRIPT_H
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct PatchBank;
+class SynthEngine;
+
+// A timestamped note/parameter script for driving the engine without the GUI.
+// One command per line, '#' starts a comment:
+//
+//   <time_ms> note_on <key> <velocity>
+//   <time_ms> note_off <key>
+//   <time_ms> envelope <attack_ms> <decay_ms> <sustain> <release_ms>
+//   <time_ms> lfo <frequency_kHz> <amplitude>
+//   <time_ms> cutoff_lfo <frequency_kHz> <amplitude>
+//   <time_ms> waveform <sin> <saw> <square>
+//   <time_ms> filter <cutoff_kHz> <Q>
+//   <time_ms> filter_bypass <0|1>
+//   <time_ms> filter_tracking <key_track> <velocity>
+//   <time_ms> delay <time_ms> <feedback> <mix>
+//   <time_ms> reverb <time_ms> <damping> <mix>
+//   <time_ms> unison <voices> <detune_cents> <spread>
+//   <time_ms> key_freq <key> <frequency_kHz>
+//   <time_ms> polyphony <max_voices> <policy>   (0 oldest, 1 quietest, 2 released first)
+//   <time_ms> oversampling <factor>   (1, 2 or 4)
+//   <time_ms> program <index>   (patch from the bank given to SynthRender)
+//   <time_ms> param <name|id> <value>   (any registry parameter, see ParamRegistry.h)
+//
+// A line reading just "part <n>" sends the commands after it to Mixer part n
+// (they go to part 0 until the first one). Units are the ones the set_*
+// functions use.
+
+enum ScriptCommand {
+    CMD_NOTE_ON, CMD_NOTE_OFF, CMD_ENVELOPE, CMD_LFO, CMD_CUTOFF_LFO,
+    CMD_WAVEFORM, CMD_FILTER, CMD_KEY_FREQ, CMD_POLYPHONY, CMD_OVERSAMPLING,
+    CMD_FILTER_BYPASS, CMD_PROGRAM, CMD_PARAM, CMD_DELAY, CMD_REVERB, CMD_UNISON, CMD_FILTER_TRACKING
+};
+
+constexpr unsigned MAX_SCRIPT_PARTS = 16;
+
+struct ScriptEvent {
+    double time;  // ms
+    unsigned part;
+    ScriptCommand command;
+    std::array<float, 4> args;
+};
+
+// Parses path into events sorted by time (same-time events keep file order).
+// Returns false and logs the offending line on a parse error.
+bool load_script(const std::string &path, std::vector<ScriptEvent> &events);
+
+// Applies one event to engine (the caller picks it by event.part). Note events
+// are queued for engine frame frame, everything else takes effect from the
+// next render() call.
+// key_map is the caller's copy of the key frequency map, key_freq events edit
+// it and republish the whole map. program events read from bank, which may be
+// empty (they are then skipped with a warning).
+void apply_script_event(const ScriptEvent &event, SynthEngine &engine, std::array<float, 256> &key_map,
+                        const PatchBank &bank, uint64_t frame);
+
+inline bool is_note_event(const ScriptEvent &event) {
+    return event.command == CMD_NOTE_ON || event.command == CMD_NOTE_OFF;
+}
+
+// Equal tempered key map with key 69 at 440 Hz, in kHz like the rest of the engine
+std::array<float, 256> default_key_map();
+
+#endif  // RENDER_SCRIPT_H
@@ -0,0 +1,63 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Fixed-capacity, wait-free single-producer/single-consumer ring buffer.
+// push() must only ever be called from one thread and pop() from one other
+// thread. Neither allocates nor locks, so the consumer side is safe to run
+// inside the audio callback. A push onto a full queue is dropped and counted.
+template <typename T, size_t Capacity>
+class SpscQueue {
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0,
+                  "SpscQueue capacity must be a power of two");
+
+public:
+    // producer side
+    bool push(const T &item) {
+        size_t head_now = head.load(std::memory_order_relaxed);
+        if (head_now - tail.load(std::memory_order_acquire) == Capacity) {
+            overflows.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        buffer[head_now & (Capacity - 1)] = item;
+        head.store(head_now + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer side
+    bool pop(T &item) {
+        size_t tail_now = tail.load(std::memory_order_relaxed);
+        if (tail_now == head.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = buffer[tail_now & (Capacity - 1)];
+        tail.store(tail_now + 1, std::memory_order_release);
+        return true;
+    }
+
+    // only exact when called from the consumer with the producer idle
+    size_t size() const {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+
+    // number of pushes rejected because the queue was full
+    uint64_t overflow_count() const {
+        return overflows.load(std::memory_order_relaxed);
+    }
+
+    static constexpr size_t capacity() { return Capacity; }
+
+private:
+    // head and tail live on separate cache lines so the two threads don't
+    // false-share while hammering them
+    alignas(64) std::atomic<size_t> head{0};  // written by producer only
+    alignas(64) std::atomic<size_t> tail{0};  // written by consumer only
+    alignas(64) std::atomic<uint64_t> overflows{0};
+    std::array<T, Capacity> buffer{};
+};
+
+#endif  // SPSC_QUEUE_H
@@ -0,0 +1,387 @@
+// Microbenchmarks for the audio hot path. Renders synthetic voice loads straight
+// through SynthEngine::render(), a Mixer and the oscillator kernels, no audio
+// device needed.
+// Results go to a CSV file, one row per configuration, so runs can be diffed
+// across commits.
+//
+//   SynthBench [--out <file.csv>] [--reps <n>] [--quick] [--threads <n>]
+//
+// --threads starts that many voice workers, so the render rows include the
+// parallel path (it only kicks in at larger voice counts), and the mixer rows
+// render their parts in parallel.
+
+#include "AudioEngine.h"
+#include "ControlRate.h"
+#include "EnvelopeGenerator.h"
+#include "Mixer.h"
+#include "OscillatorKernel.h"
+#include "VoicePool.h"
+#include "Wavetable.h"
+#include "WorkerPool.h"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <span>
+#include <string>
+#include <vector>
+
+struct WaveConfig {
+    const char *name;
+    float sin, saw, square;
+};
+
+enum BenchStage {
+    BENCH_ATTACK, BENCH_SUSTAIN, BENCH_RELEASE
+};
+
+struct Stats {
+    double mean;
+    double stddev;
+};
+
+static const WaveConfig WAVES[] = {
+        {"sine", 1, 0, 0},
+        {"saw", 0, 1, 0},
+        {"square", 0, 0, 1},
+        {"mix", 1.0f / 3, 1.0f / 3, 1.0f / 3},
+};
+
+static const char *stage_name(BenchStage stage) {
+    switch (stage) {
+        case BENCH_ATTACK: return "attack";
+        case BENCH_SUSTAIN: return "sustain";
+        case BENCH_RELEASE: return "release";
+    }
+    return "unknown";
+}
+
+static Stats stats(const std::vector<double> &values) {
+    double mean = 0;
+    for (double v : values) mean += v;
+    mean /= values.size();
+    double var = 0;
+    for (double v : values) var += (v - mean) * (v - mean);
+    var /= std::max<size_t>(1, values.size() - 1);
+    return {mean, std::sqrt(var)};
+}
+
+// keys spread from 50 Hz to 12.8 kHz, 32 keys per octave, so any voice count
+// covers a realistic range of mip levels
+static std::array<float, 256> bench_key_map() {
+    std::array<float, 256> map = {};
+    for (int key = 0; key < 256; ++key) {
+        map[key] = 0.05f * std::pow(2.0f, key / 32.0f);
+    }
+    return map;
+}
+
+// the first frames * 2 samples of scratch, as an interleaved stereo buffer
+static std::span<float> stereo(std::vector<float> &scratch, unsigned long frames) {
+    return {scratch.data(), 2 * frames};
+}
+
+// the patch every benchmark engine starts from
+static void setup_engine(SynthEngine &engine) {
+    engine.set_key_freq_map(bench_key_map());
+    // the matrix goes up to every voice at once, so no stealing
+    engine.set_polyphony(MAX_VOICES, STEAL_OLDEST);
+    engine.set_filter(5, 0.5);
+    engine.set_LFO(0.008, 0.2);
+    engine.set_cutoff_lfo(0.008, 0.2);
+}
+
+// Start `voices` notes and render until they are all in the requested stage.
+// Attack and release are made long enough to last the whole measurement.
+static void setup_voices(SynthEngine &engine, size_t voices, BenchStage stage, const WaveConfig &wave,
+                         std::vector<float> &scratch) {
+    engine.reset();
+    engine.set_waveform(wave.sin, wave.saw, wave.square);
+    switch (stage) {
+        case BENCH_ATTACK: engine.set_envelope(10000, 50, 0.5, 50); break;
+        case BENCH_SUSTAIN: engine.set_envelope(1, 1, 0.5, 10000); break;
+        case BENCH_RELEASE: engine.set_envelope(1, 1, 0.5, 10000); break;
+    }
+    for (size_t k = 0; k < voices; ++k) {
+        engine.note_on(static_cast<unsigned short>(k), 128);
+    }
+    // a few ms is enough to get through 1 ms attack and decay at any block size
+    for (int i = 0; i < 8; ++i) {
+        engine.render(stereo(scratch, 64));
+    }
+    if (stage == BENCH_RELEASE) {
+        for (size_t k = 0; k < voices; ++k) {
+            engine.note_off(static_cast<unsigned short>(k));
+        }
+        engine.render(stereo(scratch, 1));
+    }
+}
+
+int main(int argc, char **argv) {
+    std::string out_path = "synth_bench.csv";
+    int reps = 10;
+    bool quick = false;
+    unsigned threads = 0;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--out" && i + 1 < argc) {
+            out_path = argv[++i];
+        } else if (arg == "--reps" && i + 1 < argc) {
+            reps = std::max(2, std::atoi(argv[++i]));
+        } else if (arg == "--quick") {
+            quick = true;
+        } else if (arg == "--threads" && i + 1 < argc) {
+            threads = static_cast<unsigned>(std::atoi(argv[++i]));
+        } else {
+            spdlog::error("usage: SynthBench [--out <file.csv>] [--reps <n>] [--quick] [--threads <n>]");
+            return 1;
+        }
+    }
+
+    std::vector<size_t> voice_counts = {1, 2, 4, 8, 16, 32, 64, 128, 256};
+    std::vector<unsigned long> buffer_sizes = {32, 64, 128, 256, 512, 1024, 2048};
+    std::vector<BenchStage> stages = {BENCH_ATTACK, BENCH_SUSTAIN, BENCH_RELEASE};
+    if (quick) {
+        voice_counts = {1, 16, 256};
+        buffer_sizes = {32, 256, 2048};
+    }
+    // frames timed per repetition, well inside the 10 s attack/release
+    const unsigned long frames_per_rep = quick ? 4096 : 16384;
+
+    std::ofstream csv(out_path);
+    if (!csv) {
+        spdlog::error("could not open {}", out_path);
+        return 1;
+    }
+    csv << "bench,kernel,voices,buffer,wave,stage,reps,ns_per_sample,ns_per_sample_stddev,"
+           "ns_per_voice_sample,ns_per_voice_sample_stddev,realtime_load\n";
+
+    using clock = std::chrono::steady_clock;
+    const double ns_per_frame_realtime = 1e6 / DEFAULT_SAMPLERATE_kHz;
+    std::vector<float> scratch(2 * 2048);
+    SynthEngine engine;
+    setup_engine(engine);
+
+    auto write_row = [&](const char *bench, const char *kernel, size_t voices, unsigned long buffer,
+                         const char *wave, const char *stage, const std::vector<double> &ns_per_sample) {
+        Stats per_sample = stats(ns_per_sample);
+        double v = std::max<size_t>(1, voices);
+        csv << bench << ',' << kernel << ',' << voices << ',' << buffer << ',' << wave << ',' << stage << ','
+            << ns_per_sample.size() << ',' << per_sample.mean << ',' << per_sample.stddev << ','
+            << per_sample.mean / v << ',' << per_sample.stddev / v << ','
+            << per_sample.mean / ns_per_frame_realtime << '\n';
+    };
+
+    // full render path, what the audio callback costs
+    start_workers(threads);
+    const std::string render_kernel = threads > 0 ? fmt::format("auto+{}t", worker_count()) : "auto";
+    for (const WaveConfig &wave : WAVES) {
+        for (BenchStage stage : stages) {
+            for (size_t voices : voice_counts) {
+                for (unsigned long buffer : buffer_sizes) {
+                    std::vector<double> ns_per_sample;
+                    for (int rep = 0; rep < reps; ++rep) {
+                        setup_voices(engine, voices, stage, wave, scratch);
+                        auto start = clock::now();
+                        for (unsigned long done = 0; done < frames_per_rep; done += buffer) {
+                            engine.render(stereo(scratch, buffer));
+                        }
+                        double ns = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+                        ns_per_sample.push_back(ns / frames_per_rep);
+                    }
+                    if (engine.get_active_voice_count() != voices) {
+                        spdlog::warn("{} voices requested but {} sounding", voices, engine.get_active_voice_count());
+                    }
+                    write_row("render", render_kernel.c_str(), voices, buffer, wave.name, stage_name(stage), ns_per_sample);
+                }
+            }
+        }
+        spdlog::info("render path, {} done", wave.name);
+    }
+
+    // a Mixer of 1..8 parts with 16 sustained voices each, the parts render on
+    // the workers. Voices column is the total, per voice figures compare with
+    // one engine rendering that many voices on its own
+    constexpr size_t MAX_MIXER_PARTS = 8;
+    constexpr size_t VOICES_PER_PART = 16;
+    for (size_t parts = 1; parts <= MAX_MIXER_PARTS; parts *= 2) {
+        Mixer mixer(parts);
+        for (size_t p = 0; p < parts; ++p) {
+            setup_engine(mixer.part(p));
+            setup_voices(mixer.part(p), VOICES_PER_PART, BENCH_SUSTAIN, WAVES[3], scratch);
+        }
+        const std::string label = std::to_string(parts) + (threads > 0 ? fmt::format("p+{}t", worker_count()) : "p");
+        std::vector<double> ns_per_sample;
+        for (int rep = 0; rep < reps; ++rep) {
+            auto start = clock::now();
+            for (unsigned long done = 0; done < frames_per_rep; done += 256) {
+                mixer.render(stereo(scratch, 256));
+            }
+            double ns = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+            ns_per_sample.push_back(ns / frames_per_rep);
+        }
+        write_row("mixer", label.c_str(), parts * VOICES_PER_PART, 256, "mix", "sustain", ns_per_sample);
+    }
+    spdlog::info("mixer done");
+    stop_workers();
+
+    // cost of each oversampling factor on the full render path, kernel column is the factor
+    for (unsigned factor : {1u, 2u, 4u}) {
+        engine.set_oversampling(factor);
+        const std::string label = std::to_string(factor) + "x";
+        for (size_t voices : voice_counts) {
+            std::vector<double> ns_per_sample;
+            for (int rep = 0; rep < reps; ++rep) {
+                setup_voices(engine, voices, BENCH_SUSTAIN, WAVES[3], scratch);
+                auto start = clock::now();
+                for (unsigned long done = 0; done < frames_per_rep; done += 256) {
+                    engine.render(stereo(scratch, 256));
+                }
+                double ns = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+                ns_per_sample.push_back(ns / frames_per_rep);
+            }
+            write_row("oversampling", label.c_str(), voices, 256, "mix", "sustain", ns_per_sample);
+        }
+        spdlog::info("oversampling {} done", label);
+    }
+    engine.set_oversampling(1);
+
+    // unison stacks of 1..16 oscillators per voice on the full render path,
+    // mono (no spread) and stereo. Kernel column is the stack size; per voice
+    // figures should grow close to linearly with it.
+    std::vector<size_t> unison_voice_counts = {16, 64};
+    for (bool spread : {false, true}) {
+        for (unsigned unison : {1u, 2u, 4u, 8u, 16u}) {
+            engine.set_unison(unison, 20, spread ? 0.5f : 0.0f);
+            const std::string label = std::to_string(unison) + (spread && unison > 1 ? "u stereo" : "u");
+            for (size_t voices : unison_voice_counts) {
+                std::vector<double> ns_per_sample;
+                for (int rep = 0; rep < reps; ++rep) {
+                    setup_voices(engine, voices, BENCH_SUSTAIN, WAVES[1], scratch);
+                    auto start = clock::now();
+                    for (unsigned long done = 0; done < frames_per_rep; done += 256) {
+                        engine.render(stereo(scratch, 256));
+                    }
+                    double ns = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+                    ns_per_sample.push_back(ns / frames_per_rep);
+                }
+                write_row("unison", label.c_str(), voices, 256, "saw", "sustain", ns_per_sample);
+                spdlog::info("unison {}, {} voices: {:.2f} ns per oscillator sample", label, voices,
+                             stats(ns_per_sample).mean / (voices * unison));
+            }
+        }
+    }
+    engine.set_unison(1, 20, 0);
+
+    // the filter on the mix against one per voice (key tracking on), on the
+    // full render path. Kernel column is the filter; the per voice difference
+    // is what the filter lanes and their coefficient updates cost.
+    for (bool per_voice : {false, true}) {
+        engine.set_filter_tracking(per_voice ? 1.0f : 0.0f, 0);
+        const char *label = per_voice ? "voice" : "mix";
+        for (size_t voices : voice_counts) {
+            std::vector<double> ns_per_sample;
+            for (int rep = 0; rep < reps; ++rep) {
+                setup_voices(engine, voices, BENCH_SUSTAIN, WAVES[1], scratch);
+                auto start = clock::now();
+                for (unsigned long done = 0; done < frames_per_rep; done += 256) {
+                    engine.render(stereo(scratch, 256));
+                }
+                double ns = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+                ns_per_sample.push_back(ns / frames_per_rep);
+            }
+            write_row("filter", label, voices, 256, "saw", "sustain", ns_per_sample);
+        }
+        spdlog::info("{} filter done", label);
+    }
+    engine.set_filter_tracking(0, 0);
+
+    // housekeeping on its own, update_sounds() runs once per buffer (reported per
+    // sample of a 256 frame buffer) and control_update() once per control interval
+    for (size_t voices : voice_counts) {
+        std::vector<double> sounds_ns, control_ns;
+        for (int rep = 0; rep < reps; ++rep) {
+            setup_voices(engine, voices, BENCH_SUSTAIN, WAVES[3], scratch);
+            constexpr int CALLS = 1000;
+            auto start = clock::now();
+            for (int i = 0; i < CALLS; ++i) {
+                engine.profile_update_sounds();
+            }
+            sounds_ns.push_back(std::chrono::duration<double, std::nano>(clock::now() - start).count() / CALLS / 256);
+            start = clock::now();
+            for (int i = 0; i < CALLS; ++i) {
+                engine.profile_control_update();
+            }
+            control_ns.push_back(std::chrono::duration<double, std::nano>(clock::now() - start).count() / CALLS / DEFAULT_CONTROL_INTERVAL);
+        }
+        write_row("update_sounds", "-", voices, 256, "mix", "sustain", sounds_ns);
+        write_row("control_update", "-", voices, DEFAULT_CONTROL_INTERVAL, "mix", "sustain", control_ns);
+    }
+
+    // the envelope generator on its own, every voice in a 10 s exponential
+    // decay, per voice and sample
+    VoicePool pool;
+    static float env[ENVELOPE_BLOCK * MAX_VOICES];
+    const EnvelopeShape shape = envelope_shape(0, 10000, 0.5f, 10000, 5, DEFAULT_SAMPLERATE_kHz);
+    for (size_t voices : voice_counts) {
+        std::vector<double> ns_per_sample;
+        for (int rep = 0; rep < reps; ++rep) {
+            for (size_t j = 0; j < voices; ++j) {
+                pool.vol[j] = 0;
+                pool.max_vol[j] = 1;
+                envelope_enter(pool, j, ATTACK, shape);
+            }
+            auto start = clock::now();
+            for (unsigned long done = 0; done < frames_per_rep; done += ENVELOPE_BLOCK) {
+                render_envelopes(pool, 0, voices, ENVELOPE_BLOCK, shape, env, MAX_VOICES);
+            }
+            double ns = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+            ns_per_sample.push_back(ns / frames_per_rep / voices);
+        }
+        write_row("envelopes", "-", voices, ENVELOPE_BLOCK, "-", "decay", ns_per_sample);
+    }
+
+    // every oscillator kernel this CPU runs, on raw voice arrays, an envelope
+    // block at a time like the engine
+    std::array<float, 256> key_map = bench_key_map();
+    std::fill(std::begin(env), std::end(env), 0.5f);
+    for (OscKernelType type : {OSC_SCALAR, OSC_SSE41, OSC_AVX2}) {
+        if (get_oscillator_kernels(type) == nullptr) {
+            continue;
+        }
+        for (const WaveConfig &wave : WAVES) {
+            for (size_t voices : voice_counts) {
+                for (size_t j = 0; j < MAX_VOICES; ++j) {
+                    pool.phase[j] = 0;
+                    pool.phase_inc[j] = phase_increment(key_map[j], DEFAULT_SAMPLERATE_kHz);
+                }
+                OscVoices osc = {pool.phase.data(), pool.phase_inc.data(), env, MAX_VOICES, voices};
+                const WaveMix mix = {wave.sin, wave.saw, wave.square};
+                // the specialization the engine would dispatch to for this mix
+                const OscKernel kernel = get_oscillator_kernel(type, wave_mask(mix));
+                for (unsigned long buffer : buffer_sizes) {
+                    std::vector<double> ns_per_sample;
+                    for (int rep = 0; rep < reps; ++rep) {
+                        auto start = clock::now();
+                        for (unsigned long done = 0; done < frames_per_rep; done += buffer) {
+                            std::fill(scratch.begin(), scratch.begin() + buffer, 0.0f);
+                            for (unsigned long i = 0; i < buffer; i += ENVELOPE_BLOCK) {
+                                kernel(scratch.data() + i, std::min(ENVELOPE_BLOCK, buffer - i), osc, mix);
+                            }
+                        }
+                        double ns = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+                        ns_per_sample.push_back(ns / frames_per_rep);
+                    }
+                    write_row("oscillators", oscillator_kernel_name(type), voices, buffer, wave.name, "-", ns_per_sample);
+                }
+            }
+        }
+        spdlog::info("{} kernel done", oscillator_kernel_name(type));
+    }
+
+    spdlog::info("results written to {}", out_path);
+    return 0;
+}
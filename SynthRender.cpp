@@ -0,0 +1,284 @@
+// Headless offline renderer: drives the engine from a note/parameter script,
+// or replays an event recording, as fast as the CPU allows and writes the
+// result to a WAV file. Needs no audio device or display.
+//
+//   SynthRender <script|recording> <out.wav> [--block <frames>] [--tail <ms>] [--threads <n>]
+//               [--oversample <1|2|4>] [--bank <file.bank>] [--parts <n>] [--rate <Hz>]
+//               [--record <file.rec>] [--compare <golden.wav>] [--tolerance <x>]
+//
+// --bank maps a patch bank for the script's program commands. --parts renders
+// through a Mixer of n parts, addressed with the script's part lines. --rate
+// sets the output sample rate (and the WAV's), 44100 by default.
+//
+// A recording (see EventRecorder.h) carries its own settings, parts and rate,
+// so of the above only --block, --tail and --threads apply to it. It replays
+// into fresh engines, so one started mid-session loses whatever was already
+// sounding. --record captures what the render did as a recording, which
+// replays to the same samples at the same --block (at another one, voices can
+// end up summed in a different order, a rounding error's worth).
+//
+// --compare checks the render against a golden WAV: same rate and length, and
+// no sample further than --tolerance (0 by default) from it. On a mismatch it
+// logs the largest error and the first frame past tolerance and exits with 2.
+
+#include "EventRecorder.h"
+#include "Mixer.h"
+#include "PatchBank.h"
+#include "RenderScript.h"
+#include "WavWriter.h"
+#include "WorkerPool.h"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+static void usage() {
+    spdlog::error("usage: SynthRender <script|recording> <out.wav> [--block <frames>] [--tail <ms>] [--threads <n>] "
+                  "[--oversample <1|2|4>] [--bank <file.bank>] [--parts <n>] [--rate <Hz>] "
+                  "[--record <file.rec>] [--compare <golden.wav>] [--tolerance <x>]");
+}
+
+// Renders audio.size() / 2 frames from mixer. events are sorted by frame_of(event),
+// frames counted from the start of the render, and apply(event, engine frame)
+// hands each one over before the block it falls in: note events go in with
+// their exact frame, parameter changes apply between render calls so the block
+// is cut short at the next one. after_block runs after every render call.
+template <typename Event, typename FrameOf, typename Apply, typename AfterBlock>
+static void render_events(Mixer &mixer, std::vector<float> &audio, unsigned long block,
+                          const std::vector<Event> &events, FrameOf frame_of, Apply apply, AfterBlock after_block) {
+    const unsigned long total_frames = audio.size() / 2;
+    const uint64_t first_frame = mixer.part(0).get_engine_frame();
+    size_t next_event = 0;
+    for (unsigned long pos = 0; pos < total_frames;) {
+        unsigned long end = std::min(pos + block, total_frames);
+        while (next_event < events.size()) {
+            const Event &event = events[next_event];
+            unsigned long frame = frame_of(event);
+            if (frame >= end) {
+                break;
+            }
+            if (!is_note_event(event) && frame > pos) {
+                end = frame;
+                break;
+            }
+            apply(event, first_frame + frame);
+            ++next_event;
+        }
+        mixer.render(std::span<float>(audio.data() + 2 * pos, 2 * (end - pos)));
+        after_block();
+        pos = end;
+    }
+}
+
+// false (and logs where) if audio differs from golden by more than tolerance
+static bool compare_to_golden(const std::vector<float> &audio, unsigned int rate, const std::string &golden_path,
+                              float tolerance) {
+    std::vector<float> golden;
+    unsigned short channels = 0;
+    unsigned int golden_rate = 0;
+    if (!read_wav(golden_path, golden, channels, golden_rate)) {
+        return false;
+    }
+    if (channels != 2 || golden_rate != rate || golden.size() != audio.size()) {
+        spdlog::error("{} is {} channels, {} Hz, {} frames; the render is 2 channels, {} Hz, {} frames",
+                      golden_path, channels, golden_rate, golden.size() / std::max<unsigned short>(channels, 1),
+                      rate, audio.size() / 2);
+        return false;
+    }
+    float max_error = 0;
+    size_t first_bad = golden.size();
+    for (size_t i = 0; i < golden.size(); ++i) {
+        float error = std::fabs(audio[i] - golden[i]);
+        // NaN never compares, so it counts as past any tolerance
+        if (!(error <= tolerance) && first_bad == golden.size()) {
+            first_bad = i;
+        }
+        max_error = std::max(max_error, error);
+    }
+    if (first_bad != golden.size()) {
+        spdlog::error("differs from {}: max error {:g}, first past tolerance {:g} at frame {}",
+                      golden_path, max_error, tolerance, first_bad / 2);
+        return false;
+    }
+    spdlog::info("matches {} (max error {:g})", golden_path, max_error);
+    return true;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        usage();
+        return 1;
+    }
+    std::string script_path = argv[1];
+    std::string wav_path = argv[2];
+    unsigned long block = 256;
+    double tail_ms = 1000;
+    unsigned threads = 0;
+    unsigned oversample = 1;
+    unsigned parts = 1;
+    float rate_kHz = DEFAULT_SAMPLERATE_kHz;
+    std::string record_path;
+    std::string golden_path;
+    float tolerance = 0;
+    PatchBank bank;
+    for (int i = 3; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--block" && i + 1 < argc) {
+            block = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--tail" && i + 1 < argc) {
+            tail_ms = std::strtod(argv[++i], nullptr);
+        } else if (arg == "--oversample" && i + 1 < argc) {
+            oversample = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--threads" && i + 1 < argc) {
+            threads = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--rate" && i + 1 < argc) {
+            rate_kHz = std::strtof(argv[++i], nullptr) / 1000;
+        } else if (arg == "--parts" && i + 1 < argc) {
+            parts = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--record" && i + 1 < argc) {
+            record_path = argv[++i];
+        } else if (arg == "--compare" && i + 1 < argc) {
+            golden_path = argv[++i];
+        } else if (arg == "--tolerance" && i + 1 < argc) {
+            tolerance = std::strtof(argv[++i], nullptr);
+        } else if (arg == "--bank" && i + 1 < argc) {
+            if (!open_patch_bank(argv[++i], bank)) {
+                return 1;
+            }
+        } else {
+            usage();
+            return 1;
+        }
+    }
+    if (block == 0) {
+        spdlog::error("--block must be at least 1 frame");
+        return 1;
+    }
+
+    // a recording brings its own rate and parts
+    const bool replay = is_recording_file(script_path);
+    std::vector<ScriptEvent> events;
+    EventRecording recording = {};
+    if (replay) {
+        if (!read_recording(script_path, recording)) {
+            return 1;
+        }
+        rate_kHz = recording.sample_rate_kHz;
+        parts = 1;
+        for (const RecordedEvent &event : recording.events) {
+            parts = std::max(parts, event.part + 1u);
+        }
+    } else if (!load_script(script_path, events)) {
+        return 1;
+    }
+    if (rate_kHz < MIN_SAMPLERATE_kHz || rate_kHz > MAX_SAMPLERATE_kHz) {
+        spdlog::error("--rate must be {:.0f}..{:.0f} Hz", MIN_SAMPLERATE_kHz * 1000, MAX_SAMPLERATE_kHz * 1000);
+        return 1;
+    }
+    if (parts == 0 || parts > MAX_SCRIPT_PARTS) {
+        spdlog::error("--parts must be 1..{}", MAX_SCRIPT_PARTS);
+        return 1;
+    }
+    for (const ScriptEvent &event : events) {
+        if (event.part >= parts) {
+            spdlog::error("the script uses part {}, render with --parts {}", event.part, event.part + 1);
+            return 1;
+        }
+    }
+
+    Mixer mixer(parts);
+    std::vector<std::array<float, 256>> key_maps(parts, default_key_map());
+    for (unsigned p = 0; p < parts && !replay; ++p) {
+        // every part starts on the GUI's default dial positions
+        SynthEngine &engine = mixer.part(p);
+        engine.set_key_freq_map(key_maps[p]);
+        engine.set_envelope(50, 50, 0.5, 50);
+        engine.set_LFO(0.008, 0.2);
+        engine.set_waveform(1.0f / 3, 1.0f / 3, 1.0f / 3);
+        engine.set_filter(5, 0.5);
+        engine.set_cutoff_lfo(0.008, 0.2);
+        engine.set_oversampling(oversample);
+        engine.set_sample_rate(rate_kHz);
+    }
+
+    // recordings start at whatever engine frame their first event has
+    const uint64_t origin = recording.events.empty() ? 0 : recording.events.front().frame;
+    unsigned long total_frames = static_cast<unsigned long>(std::ceil(tail_ms * rate_kHz));
+    if (replay && !recording.events.empty()) {
+        total_frames += static_cast<unsigned long>(recording.events.back().frame - origin);
+    } else if (!events.empty()) {
+        total_frames = static_cast<unsigned long>(std::ceil((events.back().time + tail_ms) * rate_kHz));
+    }
+    std::vector<float> audio(total_frames * 2);
+
+    EventRecording captured = {.sample_rate_kHz = rate_kHz, .events = {}};
+    for (unsigned p = 0; p < parts && !record_path.empty(); ++p) {
+        mixer.part(p).set_recording(true);
+    }
+    auto drain_recorded = [&] {
+        for (unsigned p = 0; p < parts && !record_path.empty(); ++p) {
+            RecordedEvent event;
+            while (mixer.part(p).pop_recorded_event(event)) {
+                event.part = static_cast<uint8_t>(p);
+                captured.events.push_back(event);
+            }
+        }
+    };
+
+    start_workers(threads);
+    auto start = std::chrono::steady_clock::now();
+    if (replay) {
+        render_events(mixer, audio, block, recording.events,
+                      [&](const RecordedEvent &event) { return static_cast<unsigned long>(event.frame - origin); },
+                      [&](const RecordedEvent &event, uint64_t frame) {
+                          RecordedEvent shifted = event;
+                          shifted.frame = frame;
+                          apply_recorded_event(shifted, mixer.part(event.part), key_maps[event.part]);
+                      },
+                      drain_recorded);
+    } else {
+        render_events(mixer, audio, block, events,
+                      [&](const ScriptEvent &event) {
+                          return static_cast<unsigned long>(std::llround(event.time * rate_kHz));
+                      },
+                      [&](const ScriptEvent &event, uint64_t frame) {
+                          apply_script_event(event, mixer.part(event.part), key_maps[event.part], bank, frame);
+                      },
+                      drain_recorded);
+    }
+    double wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    stop_workers();
+    close_patch_bank(bank);
+
+    const unsigned int wav_rate = static_cast<unsigned int>(std::lround(rate_kHz * 1000));
+    if (!write_wav(wav_path, audio, 2, wav_rate)) {
+        return 1;
+    }
+    if (!record_path.empty()) {
+        // each part's events are in order already, this interleaves the parts
+        std::stable_sort(captured.events.begin(), captured.events.end(),
+                         [](const RecordedEvent &a, const RecordedEvent &b) { return a.frame < b.frame; });
+        if (!write_recording(record_path, captured)) {
+            return 1;
+        }
+    }
+
+    double audio_seconds = total_frames / (rate_kHz * 1000);
+    spdlog::info("rendered {:.2f} s of audio in {:.3f} s, realtime factor {:.1f}x",
+                 audio_seconds, wall_seconds, audio_seconds / wall_seconds);
+    for (unsigned p = 0; p < parts; ++p) {
+        if (unsigned long long dropped = mixer.part(p).get_note_event_overflows()) {
+            spdlog::warn("part {}: {} note events dropped, queue overflowed", p, dropped);
+        }
+        if (unsigned long long dropped = mixer.part(p).get_recorded_event_overflows()) {
+            spdlog::warn("part {}: {} events missing from the recording, queue overflowed", p, dropped);
+        }
+    }
+    if (!golden_path.empty() && !compare_to_golden(audio, wav_rate, golden_path, tolerance)) {
+        return 2;
+    }
+    return 0;
+}
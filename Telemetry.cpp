@@ -0,0 +1,175 @@
+#include "Telemetry.h"
+#include "SpscQueue.h"
+#include <portaudio.h>
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <thread>
+
+// load histogram in 1% buckets up to 200%, anything past that lands in the last one
+constexpr size_t LOAD_BUCKETS = 201;
+constexpr float BUCKET_WIDTH = 0.01f;
+constexpr auto RECENT_WINDOW = std::chrono::seconds(1);
+constexpr auto POLL_INTERVAL = std::chrono::milliseconds(20);
+
+struct LoadHistogram {
+    std::array<unsigned long long, LOAD_BUCKETS> buckets = {};
+    unsigned long long blocks = 0;
+    double load_sum = 0;
+    float min = 0;
+    float max = 0;
+    float min_dac_lead_ms = 0;
+    unsigned short max_voices = 0;
+    unsigned long long deadline_misses = 0;
+    unsigned long long output_underflows = 0;
+    unsigned long long output_overflows = 0;
+
+    void add(const TelemetryRecord &record) {
+        size_t bucket = std::min(LOAD_BUCKETS - 1, static_cast<size_t>(record.load / BUCKET_WIDTH));
+        ++buckets[bucket];
+        if (blocks == 0) {
+            min = max = record.load;
+            min_dac_lead_ms = record.dac_lead_ms;
+        }
+        ++blocks;
+        load_sum += record.load;
+        min = std::min(min, record.load);
+        max = std::max(max, record.load);
+        min_dac_lead_ms = std::min(min_dac_lead_ms, record.dac_lead_ms);
+        max_voices = std::max(max_voices, record.voices);
+        deadline_misses += record.load > 1.0f;
+        output_underflows += (record.status & paOutputUnderflow) != 0;
+        output_overflows += (record.status & paOutputOverflow) != 0;
+    }
+
+    // upper edge of the bucket holding the given quantile
+    float quantile(double q) const {
+        unsigned long long target = static_cast<unsigned long long>(q * blocks);
+        unsigned long long seen = 0;
+        for (size_t i = 0; i < LOAD_BUCKETS; ++i) {
+            seen += buckets[i];
+            if (seen > target) {
+                return std::min(max, (i + 1) * BUCKET_WIDTH);
+            }
+        }
+        return max;
+    }
+
+    LoadSummary summary() const {
+        return {
+                .blocks = blocks,
+                .min = min,
+                .avg = blocks ? static_cast<float>(load_sum / blocks) : 0.0f,
+                .p99 = quantile(0.99),
+                .max = max,
+                .min_dac_lead_ms = min_dac_lead_ms,
+                .max_voices = max_voices,
+                .deadline_misses = deadline_misses,
+                .output_underflows = output_underflows,
+                .output_overflows = output_overflows
+        };
+    }
+};
+
+static SpscQueue<TelemetryRecord, 4096> records;
+
+static std::thread reader;
+static std::atomic<bool> running{false};
+
+// written by the reader thread, read by whoever asks for a summary
+static std::mutex stats_mutex;
+static LoadHistogram total;
+static LoadHistogram recent_done;
+
+void telemetry_record(const TelemetryRecord &record) {
+    records.push(record);
+}
+
+static void reader_loop() {
+    LoadHistogram recent;
+    auto window_start = std::chrono::steady_clock::now();
+    while (running.load(std::memory_order_relaxed)) {
+        std::this_thread::sleep_for(POLL_INTERVAL);
+        TelemetryRecord record;
+        std::lock_guard<std::mutex> lock(stats_mutex);
+        while (records.pop(record)) {
+            total.add(record);
+            recent.add(record);
+        }
+        auto now = std::chrono::steady_clock::now();
+        if (now - window_start >= RECENT_WINDOW) {
+            recent_done = recent;
+            recent = LoadHistogram();
+            window_start = now;
+        }
+    }
+}
+
+void start_telemetry() {
+    if (running.exchange(true)) {
+        return;
+    }
+    reader = std::thread(reader_loop);
+}
+
+void stop_telemetry() {
+    if (!running.exchange(false)) {
+        return;
+    }
+    reader.join();
+    if (records.overflow_count() > 0) {
+        spdlog::warn("telemetry reader fell behind, {} records dropped", records.overflow_count());
+    }
+}
+
+LoadSummary get_recent_load() {
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    return recent_done.summary();
+}
+
+LoadSummary get_total_load() {
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    return total.summary();
+}
+
+bool dump_telemetry(const std::string &path) {
+    LoadHistogram snapshot;
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex);
+        snapshot = total;
+    }
+    LoadSummary s = snapshot.summary();
+
+    std::ofstream file(path);
+    if (!file) {
+        spdlog::error("could not open {} for writing", path);
+        return false;
+    }
+    file << "blocks " << s.blocks << '\n'
+         << "load_min " << s.min << '\n'
+         << "load_avg " << s.avg << '\n'
+         << "load_p99 " << s.p99 << '\n'
+         << "load_max " << s.max << '\n'
+         << "min_dac_lead_ms " << s.min_dac_lead_ms << '\n'
+         << "max_voices " << s.max_voices << '\n'
+         << "deadline_misses " << s.deadline_misses << '\n'
+         << "output_underflows " << s.output_underflows << '\n'
+         << "output_overflows " << s.output_overflows << '\n'
+         << "dropped_records " << records.overflow_count() << '\n'
+         << "# load_bucket_upper_edge count\n";
+    for (size_t i = 0; i < LOAD_BUCKETS; ++i) {
+        if (snapshot.buckets[i] > 0) {
+            file << (i + 1) * BUCKET_WIDTH << ' ' << snapshot.buckets[i] << '\n';
+        }
+    }
+    if (!file) {
+        spdlog::error("error while writing {}", path);
+        return false;
+    }
+    spdlog::info("telemetry written to {}", path);
+    return true;
+}
@@ -0,0 +1,46 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <string>
+
+// What the audio callback reports about each buffer it rendered
+struct TelemetryRecord {
+    float load;               // execution time as a fraction of the buffer's duration
+    float dac_lead_ms;        // how far ahead of the DAC the buffer was rendered
+    unsigned short voices;    // active voices after rendering
+    unsigned long status;     // PortAudio statusFlags for this callback
+};
+
+// Aggregated callback load, over a recent window or over the whole run
+struct LoadSummary {
+    unsigned long long blocks;
+    float min;
+    float avg;
+    float p99;
+    float max;
+    float min_dac_lead_ms;
+    unsigned short max_voices;
+    unsigned long long deadline_misses;  // load above 1, we were too slow on our own
+    unsigned long long output_underflows;
+    unsigned long long output_overflows;
+};
+
+// Audio thread: hand one record to the reader thread. Wait-free, never
+// allocates, and drops (and counts) the record if the reader has fallen behind.
+void telemetry_record(const TelemetryRecord &record);
+
+// Start/stop the reader thread that drains the records into histograms
+void start_telemetry();
+void stop_telemetry();
+
+// the last completed ~1 s window, for meters
+LoadSummary get_recent_load();
+
+// everything since start_telemetry()
+LoadSummary get_total_load();
+
+// Writes the totals and the full load histogram as text. Returns false and
+// logs if the file can't be written.
+bool dump_telemetry(const std::string &path);
+
+#endif  // TELEMETRY_H
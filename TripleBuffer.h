@@ -0,0 +1,53 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+#include <cstdint>
+
+// Lock-free triple buffer for handing whole objects from one writer thread to
+// one reader thread. The writer fills write_buffer() and calls publish(); the
+// reader calls read() and gets the most recently published object, which stays
+// untouched until its next read(). Neither side ever blocks or allocates, and
+// the reader can never observe a half-written object.
+template <typename T>
+class TripleBuffer {
+public:
+    TripleBuffer() = default;
+
+    explicit TripleBuffer(const T &initial) {
+        buffers[0] = initial;
+        buffers[1] = initial;
+        buffers[2] = initial;
+    }
+
+    // writer side
+    T &write_buffer() {
+        return buffers[back];
+    }
+
+    void publish() {
+        // hand the back buffer over as the new middle and take the old middle
+        uint8_t old_middle = middle.exchange(back | FRESH, std::memory_order_acq_rel);
+        back = old_middle & INDEX_MASK;
+    }
+
+    // reader side
+    const T &read() {
+        if (middle.load(std::memory_order_relaxed) & FRESH) {
+            uint8_t new_front = middle.exchange(front, std::memory_order_acq_rel);
+            front = new_front & INDEX_MASK;
+        }
+        return buffers[front];
+    }
+
+private:
+    static constexpr uint8_t INDEX_MASK = 0x3;
+    static constexpr uint8_t FRESH = 0x4;
+
+    T buffers[3] = {};
+    std::atomic<uint8_t> middle{1};
+    uint8_t front = 0;  // owned by the reader
+    uint8_t back = 2;   // owned by the writer
+};
+
+#endif  // TRIPLE_BUFFER_H
@@ -0,0 +1,178 @@
+#ifndef VOICE_POOL_H
+#define VOICE_POOL_H
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include "Biquad.h"
+
+constexpr size_t MAX_VOICES = 256;
+// unison oscillators per voice
+constexpr size_t MAX_UNISON = 16;
+constexpr size_t MAX_OSCILLATORS = MAX_VOICES * MAX_UNISON;
+constexpr short NO_VOICE = -1;
+
+// STOLEN voices were taken by the polyphony cap, they have no key any more and
+// fade out quickly before being removed
+enum EnvelopeStage {
+    ATTACK, DECAY, SUSTAIN, RELEASE, STOLEN
+};
+
+// Structure-of-arrays storage for every sounding voice. Active voices are kept
+// packed at the front of the arrays, so [0, count) is the active voice list and
+// each field can be streamed (and vectorized) without skipping dead slots.
+// key_to_voice maps a key to its voice index, or NO_VOICE.
+//
+// Every voice plays a stack of unison oscillators sharing its envelope. The
+// oscillator arrays hold voice v's stack at [v * unison, (v + 1) * unison),
+// so the active voices' oscillators are packed at the front too and a stack
+// renders in adjacent SIMD lanes. Each oscillator also has its own filter
+// lane (see BiquadLanes), only run while the filter is per voice. Lanes past
+// the active oscillators always have zero history and step, so the SIMD
+// kernels can run them along with the live ones and they stay silent.
+// Only the audio thread touches this.
+struct VoicePool {
+    alignas(32) std::array<float, MAX_VOICES> frequency;
+    alignas(32) std::array<uint32_t, MAX_OSCILLATORS> phase;      // fixed point cycles, see Wavetable.h
+    alignas(32) std::array<uint32_t, MAX_OSCILLATORS> phase_inc;  // per sample
+    alignas(32) std::array<float, MAX_VOICES> vol;      // envelope level, see EnvelopeGenerator.h
+    alignas(32) std::array<float, MAX_VOICES> max_vol;  // envelope peak
+    // current envelope segment: vol = vol * env_mul + env_add per sample, for
+    // env_remaining more samples, after which vol lands exactly on env_target
+    alignas(32) std::array<float, MAX_VOICES> env_mul;
+    alignas(32) std::array<float, MAX_VOICES> env_add;
+    alignas(32) std::array<float, MAX_VOICES> env_target;
+    alignas(32) std::array<uint32_t, MAX_VOICES> env_remaining;
+    std::array<EnvelopeStage, MAX_VOICES> stage;
+    std::array<bool, MAX_VOICES> note_on;  // key is pressed (distinct from sound is playing)
+    std::array<unsigned short, MAX_VOICES> key;  // key that owns each voice
+    std::array<uint32_t, MAX_VOICES> started;    // note on order, for oldest-first stealing
+    // per oscillator, laid out like phase
+    alignas(32) std::array<float, MAX_OSCILLATORS> filter_coefficient[BIQUAD_COEFFICIENTS];
+    alignas(32) std::array<float, MAX_OSCILLATORS> filter_step[BIQUAD_COEFFICIENTS];
+    alignas(32) std::array<float, MAX_OSCILLATORS> filter_history[BIQUAD_HISTORY];
+
+    std::array<short, 256> key_to_voice;
+    size_t count = 0;
+    size_t unison = 1;  // oscillators per voice
+    uint32_t next_start = 0;
+
+    VoicePool() {
+        clear();
+    }
+
+    void clear() {
+        key_to_voice.fill(NO_VOICE);
+        count = 0;
+        for (auto &coefficient : filter_coefficient) {
+            coefficient.fill(0.0f);
+        }
+        clear_filters(0, MAX_OSCILLATORS);
+    }
+
+    // the filter lanes from oscillator slot first on
+    BiquadLanes filter_lanes(size_t first) {
+        BiquadLanes lanes;
+        for (size_t c = 0; c < BIQUAD_COEFFICIENTS; ++c) {
+            lanes.coefficient[c] = filter_coefficient[c].data() + first;
+            lanes.step[c] = filter_step[c].data() + first;
+        }
+        for (size_t h = 0; h < BIQUAD_HISTORY; ++h) {
+            lanes.history[h] = filter_history[h].data() + first;
+        }
+        return lanes;
+    }
+
+    // no history and no ramp for oscillator slots [first, first + n)
+    void clear_filters(size_t first, size_t n) {
+        for (auto &step : filter_step) {
+            std::fill_n(step.begin() + first, n, 0.0f);
+        }
+        for (auto &history : filter_history) {
+            std::fill_n(history.begin() + first, n, 0.0f);
+        }
+    }
+
+    // Voice v's filter lanes from a stack of old oscillators to one of
+    // unison: the oscillators both sizes have keep theirs, extra ones start
+    // with no history on the first one's coefficients and ramp.
+    void restack_filters(size_t v, size_t old, size_t unison) {
+        const size_t kept = std::min(old, unison);
+        auto restack = [&](std::array<float, MAX_OSCILLATORS> &lane, bool history) {
+            std::array<float, MAX_UNISON> saved;
+            std::copy_n(lane.begin() + v * old, kept, saved.begin());
+            for (size_t k = 0; k < unison; ++k) {
+                lane[v * unison + k] = k < kept ? saved[k] : history ? 0.0f : saved[0];
+            }
+        };
+        for (size_t c = 0; c < BIQUAD_COEFFICIENTS; ++c) {
+            restack(filter_coefficient[c], false);
+            restack(filter_step[c], false);
+        }
+        for (auto &history : filter_history) {
+            restack(history, true);
+        }
+    }
+
+    // filter lanes of oscillator slots [from, from + n) to [to, to + n)
+    void copy_filters(size_t from, size_t to, size_t n) {
+        for (size_t c = 0; c < BIQUAD_COEFFICIENTS; ++c) {
+            std::copy_n(filter_coefficient[c].begin() + from, n, filter_coefficient[c].begin() + to);
+            std::copy_n(filter_step[c].begin() + from, n, filter_step[c].begin() + to);
+        }
+        for (auto &history : filter_history) {
+            std::copy_n(history.begin() + from, n, history.begin() + to);
+        }
+    }
+
+    short find(unsigned short k) const {
+        return key_to_voice[k];
+    }
+
+    // claim the next slot for key k, caller fills in the per-voice state.
+    // There is a slot for every key, so this can't fail as long as k has no voice yet
+    size_t add(unsigned short k) {
+        size_t v = count++;
+        key[v] = k;
+        started[v] = next_start++;
+        key_to_voice[k] = static_cast<short>(v);
+        return v;
+    }
+
+    // let go of voice v's key so the key can start a new voice while v keeps
+    // sounding on its own
+    void detach(size_t v) {
+        if (key_to_voice[key[v]] == static_cast<short>(v)) {
+            key_to_voice[key[v]] = NO_VOICE;
+        }
+    }
+
+    // drop voice v by moving the last active voice into its slot
+    void remove(size_t v) {
+        detach(v);
+        size_t last = --count;
+        if (v != last) {
+            frequency[v] = frequency[last];
+            std::copy_n(phase.begin() + last * unison, unison, phase.begin() + v * unison);
+            std::copy_n(phase_inc.begin() + last * unison, unison, phase_inc.begin() + v * unison);
+            copy_filters(last * unison, v * unison, unison);
+            vol[v] = vol[last];
+            max_vol[v] = max_vol[last];
+            env_mul[v] = env_mul[last];
+            env_add[v] = env_add[last];
+            env_target[v] = env_target[last];
+            env_remaining[v] = env_remaining[last];
+            stage[v] = stage[last];
+            note_on[v] = note_on[last];
+            key[v] = key[last];
+            started[v] = started[last];
+            if (key_to_voice[key[v]] == static_cast<short>(last)) {
+                key_to_voice[key[v]] = static_cast<short>(v);
+            }
+        }
+        clear_filters(last * unison, unison);
+    }
+};
+
+#endif  // VOICE_POOL_H
@@ -0,0 +1,123 @@
+#include "WavWriter.h"
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <spdlog/spdlog.h>
+
+// WAV is little endian, write field by field so host struct padding and byte
+// order never leak into the file
+static void put_u16(std::ofstream &file, uint16_t value) {
+    char bytes[2] = {static_cast<char>(value & 0xff), static_cast<char>(value >> 8)};
+    file.write(bytes, 2);
+}
+
+static void put_u32(std::ofstream &file, uint32_t value) {
+    char bytes[4];
+    for (int i = 0; i < 4; ++i) {
+        bytes[i] = static_cast<char>((value >> (8 * i)) & 0xff);
+    }
+    file.write(bytes, 4);
+}
+
+bool write_wav(const std::string &path, const std::vector<float> &samples,
+               unsigned short channels, unsigned int sample_rate) {
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        spdlog::error("could not open {} for writing", path);
+        return false;
+    }
+
+    const uint32_t data_bytes = static_cast<uint32_t>(samples.size() * sizeof(float));
+    const uint32_t frames = static_cast<uint32_t>(samples.size() / channels);
+
+    file.write("RIFF", 4);
+    put_u32(file, 4 + (8 + 18) + (8 + 4) + (8 + data_bytes));
+    file.write("WAVE", 4);
+
+    file.write("fmt ", 4);
+    put_u32(file, 18);
+    put_u16(file, 3);  // WAVE_FORMAT_IEEE_FLOAT
+    put_u16(file, channels);
+    put_u32(file, sample_rate);
+    put_u32(file, sample_rate * channels * sizeof(float));  // byte rate
+    put_u16(file, channels * sizeof(float));  // block align
+    put_u16(file, 32);  // bits per sample
+    put_u16(file, 0);  // no extension
+
+    // non-PCM formats need a fact chunk
+    file.write("fact", 4);
+    put_u32(file, 4);
+    put_u32(file, frames);
+
+    file.write("data", 4);
+    put_u32(file, data_bytes);
+    std::vector<char> data(data_bytes);
+    for (size_t i = 0; i < samples.size(); ++i) {
+        uint32_t bits;
+        static_assert(sizeof(bits) == sizeof(float));
+        std::memcpy(&bits, &samples[i], sizeof(bits));
+        for (int b = 0; b < 4; ++b) {
+            data[4 * i + b] = static_cast<char>((bits >> (8 * b)) & 0xff);
+        }
+    }
+    file.write(data.data(), data.size());
+
+    if (!file) {
+        spdlog::error("error while writing {}", path);
+        return false;
+    }
+    return true;
+}
+
+static uint16_t get_u16(const unsigned char *p) {
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+static uint32_t get_u32(const unsigned char *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+bool read_wav(const std::string &path, std::vector<float> &samples,
+              unsigned short &channels, unsigned int &sample_rate) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        spdlog::error("could not open {}", path);
+        return false;
+    }
+    std::vector<unsigned char> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (bytes.size() < 12 || std::memcmp(bytes.data(), "RIFF", 4) != 0 || std::memcmp(&bytes[8], "WAVE", 4) != 0) {
+        spdlog::error("{} is not a WAV file", path);
+        return false;
+    }
+
+    // walk the chunks, fmt has to come before data
+    bool have_format = false;
+    for (size_t pos = 12; pos + 8 <= bytes.size();) {
+        const unsigned char *chunk = &bytes[pos];
+        size_t size = get_u32(chunk + 4);
+        size_t body = pos + 8;
+        if (size > bytes.size() - body) {
+            break;
+        }
+        if (std::memcmp(chunk, "fmt ", 4) == 0 && size >= 16) {
+            if (get_u16(chunk + 8) != 3 || get_u16(chunk + 22) != 32) {
+                spdlog::error("{}: only 32 bit float WAV files are supported", path);
+                return false;
+            }
+            channels = get_u16(chunk + 10);
+            sample_rate = get_u32(chunk + 12);
+            have_format = channels != 0;
+        } else if (std::memcmp(chunk, "data", 4) == 0 && have_format) {
+            samples.resize(size / sizeof(float));
+            for (size_t i = 0; i < samples.size(); ++i) {
+                uint32_t bits = get_u32(&bytes[body + 4 * i]);
+                std::memcpy(&samples[i], &bits, sizeof(bits));
+            }
+            return true;
+        }
+        pos = body + size + (size & 1);  // chunks are padded to even sizes
+    }
+    spdlog::error("{}: no float sample data", path);
+    return false;
+}
@@ -0,0 +1,17 @@
+#ifndef WAV_WRITER_H
+#define WAV_WRITER_H
+
+#include <string>
+#include <vector>
+
+// Writes interleaved float samples as a 32 bit IEEE float WAV file.
+// Returns false (and logs why) if the file couldn't be written.
+bool write_wav(const std::string &path, const std::vector<float> &samples,
+               unsigned short channels, unsigned int sample_rate);
+
+// Reads a file written by write_wav() (any 32 bit float WAV) back into
+// interleaved samples. Returns false (and logs why) for anything else.
+bool read_wav(const std::string &path, std::vector<float> &samples,
+              unsigned short &channels, unsigned int &sample_rate);
+
+#endif  // WAV_WRITER_H
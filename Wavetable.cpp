@@ -0,0 +1,52 @@
+#include "Wavetable.h"
+#include <cmath>
+#include <memory>
+
+// Additive synthesis of every level. The saw and square keep the scaling of the
+// naive waveforms they replace (4p - 2 and +-1), and every harmonic is read from
+// the sine table itself since sin(2*pi*h*i/N) = sine[h*i mod N].
+static std::unique_ptr<Wavetables> build_wavetables() {
+    auto tables = std::make_unique<Wavetables>();
+    for (size_t i = 0; i < WAVETABLE_STRIDE; ++i) {
+        tables->sine[i] = static_cast<float>(std::sin(2.0 * M_PI * i / WAVETABLE_SIZE));
+    }
+
+    // build from the top level down, each level is the one above plus more harmonics
+    std::array<double, WAVETABLE_SIZE> saw = {};
+    std::array<double, WAVETABLE_SIZE> square = {};
+    size_t harmonics = 0;
+    for (size_t level = WAVETABLE_LEVELS; level-- > 0;) {
+        size_t level_harmonics = size_t(1) << (WAVETABLE_LEVELS - 1 - level);
+        for (size_t h = harmonics + 1; h <= level_harmonics; ++h) {
+            double saw_amp = -4.0 / (M_PI * h);
+            double square_amp = (h % 2 == 1) ? 4.0 / (M_PI * h) : 0.0;
+            for (size_t i = 0; i < WAVETABLE_SIZE; ++i) {
+                double s = tables->sine[(h * i) & (WAVETABLE_SIZE - 1)];
+                saw[i] += saw_amp * s;
+                square[i] += square_amp * s;
+            }
+        }
+        harmonics = level_harmonics;
+
+        float *saw_level = tables->saw.data() + level * WAVETABLE_STRIDE;
+        float *square_level = tables->square.data() + level * WAVETABLE_STRIDE;
+        for (size_t i = 0; i < WAVETABLE_SIZE; ++i) {
+            saw_level[i] = static_cast<float>(saw[i]);
+            square_level[i] = static_cast<float>(square[i]);
+        }
+        saw_level[WAVETABLE_SIZE] = saw_level[0];
+        square_level[WAVETABLE_SIZE] = square_level[0];
+    }
+    return tables;
+}
+
+const Wavetables &get_wavetables() {
+    static const std::unique_ptr<Wavetables> tables = build_wavetables();
+    return *tables;
+}
+
+uint32_t phase_increment(float frequency, float sample_rate) {
+    double cycles = static_cast<double>(frequency) / sample_rate;
+    cycles -= std::floor(cycles);
+    return static_cast<uint32_t>(cycles * 4294967296.0);
+}
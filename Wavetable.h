@@ -0,0 +1,52 @@
+#ifndef WAVETABLE_H
+#define WAVETABLE_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Band-limited single-cycle tables, one per octave ("mip level").
+// Phases are 32 bit fixed point cycles: the top WAVETABLE_BITS select the table
+// entry and the rest are the interpolation fraction. Level k holds 2^(10-k)
+// harmonics and is used for phase increments up to 2^(21+k), so no harmonic ever
+// reaches Nyquist. Sine has a single harmonic and only needs one level.
+constexpr int WAVETABLE_BITS = 11;
+constexpr size_t WAVETABLE_SIZE = size_t(1) << WAVETABLE_BITS;
+constexpr size_t WAVETABLE_STRIDE = WAVETABLE_SIZE + 1;  // guard point for interpolation
+constexpr size_t WAVETABLE_LEVELS = 11;
+constexpr int WAVETABLE_FRAC_BITS = 32 - WAVETABLE_BITS;
+constexpr uint32_t WAVETABLE_FRAC_MASK = (uint32_t(1) << WAVETABLE_FRAC_BITS) - 1;
+constexpr float WAVETABLE_FRAC_SCALE = 1.0f / (uint32_t(1) << WAVETABLE_FRAC_BITS);
+
+struct Wavetables {
+    alignas(64) std::array<float, WAVETABLE_STRIDE> sine;
+    // levels stored back to back, level k starts at k * WAVETABLE_STRIDE
+    alignas(64) std::array<float, WAVETABLE_STRIDE * WAVETABLE_LEVELS> saw;
+    alignas(64) std::array<float, WAVETABLE_STRIDE * WAVETABLE_LEVELS> square;
+};
+
+// Built on first use, make sure that happens outside the audio callback
+const Wavetables &get_wavetables();
+
+// mip level to read for a voice advancing phase_inc per sample
+inline size_t wavetable_level(uint32_t phase_inc) {
+    size_t level = 0;
+    uint32_t limit = uint32_t(1) << (WAVETABLE_FRAC_BITS);
+    while (level < WAVETABLE_LEVELS - 1 && phase_inc > limit) {
+        ++level;
+        limit <<= 1;
+    }
+    return level;
+}
+
+// linearly interpolated read of one table level
+inline float wavetable_read(const float *table, uint32_t phase) {
+    uint32_t index = phase >> WAVETABLE_FRAC_BITS;
+    float frac = static_cast<float>(phase & WAVETABLE_FRAC_MASK) * WAVETABLE_FRAC_SCALE;
+    return table[index] + frac * (table[index + 1] - table[index]);
+}
+
+// fixed point phase increment for a frequency in kHz at a sample rate in kHz
+uint32_t phase_increment(float frequency, float sample_rate);
+
+#endif  // WAVETABLE_H
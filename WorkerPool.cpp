@@ -0,0 +1,208 @@
+#include "WorkerPool.h"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+static inline void cpu_relax() { _mm_pause(); }
+#elif defined(__aarch64__)
+static inline void cpu_relax() { asm volatile("yield"); }
+#else
+static inline void cpu_relax() {}
+#endif
+
+// roughly tens of microseconds of spinning before a worker goes to sleep, so
+// back to back jobs within a buffer don't pay for a wake up
+constexpr int SPIN_ITERATIONS = 20000;
+
+// The current batch. Every job of the previous batch has finished by the time
+// these are rewritten, but a late worker can still be in drain() holding that
+// batch's claims value. run_parallel() therefore retags claims with the new
+// generation (and no jobs left) before touching the fields, so the late
+// worker's claim fails, and only then publishes the real claims. batch_jobs is
+// stored with release and read with acquire, so anyone who sees the new count
+// also sees claims already retagged.
+static std::atomic<ParallelJob> batch_job{nullptr};
+static std::atomic<void *> batch_context{nullptr};
+static std::atomic<unsigned> batch_jobs{0};
+
+// generation in the high 32 bits, index of the next unclaimed job in the low 32.
+// Tagging claims with the generation stops a late worker from claiming jobs of
+// a batch it hasn't been woken for.
+static std::atomic<uint64_t> claims{0};
+static std::atomic<unsigned> jobs_done{0};
+
+// bumped once per batch, workers sleep on it
+static std::atomic<uint32_t> generation{0};
+// workers inside (or about to enter) wait_for_generation(), so the caller can
+// skip the wake up syscall while everyone is still spinning
+static std::atomic<int> sleepers{0};
+static std::atomic<bool> stopping{false};
+static std::vector<std::thread> workers;
+// set while this thread runs a job of a batch, see in_parallel_job()
+static thread_local bool running_job = false;
+
+#if defined(__linux__)
+static void wait_for_generation(uint32_t seen) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(&generation), FUTEX_WAIT_PRIVATE, seen, nullptr, nullptr, 0);
+}
+
+static void wake_workers() {
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(&generation), FUTEX_WAKE_PRIVATE, INT32_MAX, nullptr, nullptr, 0);
+}
+#else
+// No futex here. The waker doesn't take the mutex, so a wake up can be missed
+// in a narrow window; the timeout bounds how long a worker sits out.
+static std::mutex sleep_mutex;
+static std::condition_variable sleep_cv;
+
+static void wait_for_generation(uint32_t seen) {
+    std::unique_lock<std::mutex> lock(sleep_mutex);
+    sleep_cv.wait_for(lock, std::chrono::milliseconds(1),
+                      [seen] { return generation.load(std::memory_order_acquire) != seen; });
+}
+
+static void wake_workers() {
+    sleep_cv.notify_all();
+}
+#endif
+
+// claim and run jobs of generation gen until there are none left
+static void drain(uint32_t gen, unsigned thread) {
+    uint64_t current = claims.load(std::memory_order_acquire);
+    for (;;) {
+        if (static_cast<uint32_t>(current >> 32) != gen) {
+            return;
+        }
+        unsigned index = static_cast<unsigned>(current & 0xffffffffu);
+        if (index >= batch_jobs.load(std::memory_order_acquire)) {
+            return;
+        }
+        if (claims.compare_exchange_weak(current, current + 1, std::memory_order_acq_rel)) {
+            running_job = true;
+            batch_job.load(std::memory_order_relaxed)(batch_context.load(std::memory_order_relaxed), index, thread);
+            running_job = false;
+            jobs_done.fetch_add(1, std::memory_order_release);
+            current = claims.load(std::memory_order_acquire);
+        }
+    }
+}
+
+static void pin_and_prioritize(unsigned thread) {
+#if defined(__linux__)
+    unsigned cpus = std::max(1u, std::thread::hardware_concurrency());
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(thread % cpus, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+        spdlog::debug("could not pin worker {} to cpu {}", thread, thread % cpus);
+    }
+    // below the audio thread, but above everything that isn't real time.
+    // Needs the right privileges, runs at normal priority otherwise
+    sched_param param = {};
+    param.sched_priority = std::max(1, sched_get_priority_max(SCHED_FIFO) - 10);
+    if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0) {
+        spdlog::debug("worker {} running without real time priority", thread);
+    }
+#else
+    // macOS has no hard affinity, leave placement to the scheduler
+    (void)thread;
+#endif
+}
+
+static void worker_loop(unsigned thread) {
+    pin_and_prioritize(thread);
+    uint32_t seen = generation.load(std::memory_order_acquire);
+    while (!stopping.load(std::memory_order_acquire)) {
+        uint32_t now = seen;
+        for (int i = 0; i < SPIN_ITERATIONS && now == seen; ++i) {
+            cpu_relax();
+            now = generation.load(std::memory_order_acquire);
+        }
+        if (now == seen) {
+            // seq_cst pairs with the caller bumping generation and then reading
+            // sleepers: either it sees us here, or the futex sees the new generation
+            sleepers.fetch_add(1, std::memory_order_seq_cst);
+            wait_for_generation(seen);
+            sleepers.fetch_sub(1, std::memory_order_relaxed);
+            continue;
+        }
+        seen = now;
+        drain(seen, thread);
+    }
+}
+
+void start_workers(unsigned count) {
+    stop_workers();
+    count = std::min(count, MAX_WORKERS);
+    stopping.store(false);
+    for (unsigned i = 1; i <= count; ++i) {
+        workers.emplace_back(worker_loop, i);
+    }
+    spdlog::info("started {} voice worker threads", count);
+}
+
+void stop_workers() {
+    if (workers.empty()) {
+        return;
+    }
+    stopping.store(true, std::memory_order_release);
+    generation.fetch_add(1, std::memory_order_acq_rel);
+    wake_workers();
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+    workers.clear();
+}
+
+unsigned worker_count() {
+    return static_cast<unsigned>(workers.size());
+}
+
+bool in_parallel_job() {
+    return running_job;
+}
+
+void run_parallel(ParallelJob job, void *context, unsigned jobs) {
+    if (workers.empty() || jobs <= 1) {
+        for (unsigned i = 0; i < jobs; ++i) {
+            job(context, i, 0);
+        }
+        return;
+    }
+
+    uint32_t gen = generation.load(std::memory_order_relaxed) + 1;
+    // no jobs claimable while the fields change, see batch_job
+    claims.store((static_cast<uint64_t>(gen) << 32) | 0xffffffffu, std::memory_order_relaxed);
+    batch_job.store(job, std::memory_order_relaxed);
+    batch_context.store(context, std::memory_order_relaxed);
+    jobs_done.store(0, std::memory_order_relaxed);
+    batch_jobs.store(jobs, std::memory_order_release);
+    claims.store(static_cast<uint64_t>(gen) << 32, std::memory_order_release);
+    generation.store(gen, std::memory_order_seq_cst);
+    if (sleepers.load(std::memory_order_seq_cst) > 0) {
+        wake_workers();
+    }
+
+    drain(gen, 0);
+    // whatever is left was claimed by a worker that is already running it
+    while (jobs_done.load(std::memory_order_acquire) < jobs) {
+        cpu_relax();
+    }
+}
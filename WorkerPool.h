@@ -0,0 +1,34 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+// Real-time safe fan-out of independent jobs onto a pool of worker threads.
+// The threads are created (and pinned, where the OS allows it) by
+// start_workers() outside the audio callback. run_parallel() only touches
+// atomics: jobs are claimed lock-free from a shared counter, idle workers spin
+// briefly and then sleep on a futex, and the calling thread works through the
+// jobs too. It never waits for a worker that hasn't claimed a job, so a worker
+// that is slow to wake costs parallelism, not a missed deadline.
+
+constexpr unsigned MAX_WORKERS = 15;
+constexpr unsigned MAX_POOL_THREADS = MAX_WORKERS + 1;  // workers plus the caller
+
+// thread is 0 for the calling thread and 1..worker_count() for the workers,
+// handy for indexing per-thread scratch buffers
+using ParallelJob = void (*)(void *context, unsigned job, unsigned thread);
+
+// count is clamped to MAX_WORKERS, 0 leaves everything on the calling thread
+void start_workers(unsigned count);
+void stop_workers();
+unsigned worker_count();
+
+// Runs job(context, i, thread) for every i in [0, jobs) and returns once all
+// of them are done. Only one thread may call this at a time, and never from
+// inside a job.
+void run_parallel(ParallelJob job, void *context, unsigned jobs);
+
+// true while the calling thread is running a job for run_parallel(), so code
+// that may run either way (an engine rendered as one Mixer part) can stay
+// serial instead of nesting
+bool in_parallel_job();
+
+#endif  // WORKER_POOL_H
@@ -4,10 +4,27 @@
 #include <Fl/Fl_Dial.H>
 #include <Fl/Fl_Button.H>
 #include <Fl/Fl_Pack.H>
+#include <FL/Fl_Progress.H>
+#include <FL/Fl_Box.H>
 #include "AudioEngine.h"
+#include "Mixer.h"
+#include "AudioBackend.h"
+#include "Telemetry.h"
+#include "WorkerPool.h"
+#include "OscServer.h"
+#include "PatchBank.h"
+#include "ParamRegistry.h"
+#include "EventRecorder.h"
 #include <spdlog/spdlog.h>
 #include <array>
 #include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
 
 class MyVerticalDial : public Fl_Dial {
     float min_value;
@@ -47,18 +64,53 @@ public:
 
 class MyWindow : public Fl_Window {
 
+    static constexpr double CPU_METER_INTERVAL = 0.25;  // seconds
+    static constexpr double OSC_POLL_INTERVAL = 0.005;  // seconds
+    // dial changes reach the engine at most this often, however fast they move
+    static constexpr double PARAM_PUBLISH_INTERVAL = 0.02;  // seconds
+    static constexpr uint32_t WAVE_PARAMS = 1u << PARAM_SIN | 1u << PARAM_SAW | 1u << PARAM_SQUARE;
+    static constexpr const char *PATCH_BANK_PATH = "synth_patches.bank";
+    static constexpr const char *RECORDING_PATH = "synth_session.rec";
+
     MyVerticalDial *attack_dial, *decay_dial, *sustain_dial, *release_dial;
     MyVerticalDial *vol_lfo_freq_dial, *vol_lfo_amp_dial;
     MyVerticalDial *cutoff_lfo_freq_dial, *cutoff_lfo_amp_dial;
     MyVerticalDial *sine_dial, *saw_dial, *square_dial;
     MyVerticalDial *filter_cutoff_dial, *filter_Q_dial;
+    MyVerticalDial *delay_time_dial, *delay_feedback_dial, *delay_mix_dial;
+    MyVerticalDial *reverb_time_dial, *reverb_damping_dial, *reverb_mix_dial;
+    MyVerticalDial *unison_voices_dial, *unison_detune_dial, *unison_spread_dial;
+    // the dial for each parameter (nullptr for the ones without), and what
+    // they are set to
+    std::array<MyVerticalDial *, PARAM_COUNT> param_dials = {};
+    ParamSet params;
     std::array<int, 256> key_remap = {};
     Fl_Button *transpose_up_button, *transpose_down_button;
+    Fl_Progress *cpu_meter;
+    Fl_Button *dump_telemetry_button;
+    Fl_Button *oversampling_button;
+    unsigned oversampling = 1;
+    // the dials, keyboard and patch buttons play and edit one part at a time
+    Mixer &mixer;
+    Fl_Button *part_button;
+    size_t part = 0;
+    char part_label[16] = "Part 1";
+    char cpu_meter_label[96] = "";
+    Fl_Button *patch_prev_button, *patch_next_button, *patch_save_button;
+    Fl_Box *patch_label;
+    char patch_label_text[PATCH_NAME_LENGTH + 16] = "no patch bank";
+    PatchBank bank;
+    size_t patch_index = 0;
+    // Rec captures every part's events until pressed again, then saves them for
+    // SynthRender to replay
+    Fl_Button *record_button;
+    EventRecording recording = {};
+    bool recording_on = false;
     float octave_scale;
 
     public:
 
-        MyWindow(int w, int h) : Fl_Window(w, h) {
+        MyWindow(int w, int h, Mixer &mixer) : Fl_Window(w, h), mixer(mixer) {
             // create key map (colemak)
             key_remap[97] = 0;
             key_remap[114] = 1;
@@ -72,22 +124,7 @@ class MyWindow : public Fl_Window {
             key_remap[111] = 9;
             key_remap[39] = 10;
 
-            // Define min, max, and set values for dials
-            std::array<float, 3> attack_min_max_set = {1, 1000.0, 50};
-            std::array<float, 3> decay_min_max_set = {1.0, 1000, 50};
-            std::array<float, 3> sustain_min_max_set = {0, 1, 0.5};
-            std::array<float, 3> release_min_max_set = {1, 1000, 50};
-
-            std::array<float, 3> lfo_freq_min_max_set = {0.0001, 0.01, 0.008};
-            std::array<float, 3> lfo_amp_min_max_set = {0, 1.0, 0.2};
-
-            std::array<float, 3> wave_min_max_set = {0.0f, 1.0f, 0.5};  // Used for sine, square, and saw
-
-            std::array<float, 3> cutoff_min_max_set = {0.01f, 20, 5};
-            std::array<float, 3> Q_min_max_set = {0.1, 5, 0.5};
-
-            std::array<float, 3> cutoff_lfo_freq_min_max_set = {0.0001, 0.01, 0.008};
-            std::array<float, 3> cutoff_lfo_amp_min_max_set = {0, 1.0, 0.2};
+            // ranges and starting values come from the parameter registry
 
             // Define positions and dimensions for widgets
             std::array<int, 4> attack_dial_pos =    {10, 10, 50, 50};
@@ -113,46 +150,110 @@ class MyWindow : public Fl_Window {
             std::array<int, 4> cutoff_lfo_freq_dial_pos =   {280, 130, 50, 50};
             std::array<int, 4> cutoff_lfo_amp_dial_pos =    {360, 130, 50, 50};
 
+            std::array<int, 4> cpu_meter_pos =              {450, 215, 200, 25};
+            std::array<int, 4> dump_telemetry_button_pos =  {660, 215, 80, 25};
+            std::array<int, 4> oversampling_button_pos =    {660, 120, 80, 30};
+            std::array<int, 4> part_button_pos =            {660, 160, 80, 30};
+            std::array<int, 4> record_button_pos =          {660, 80, 80, 30};
+
+            std::array<int, 4> patch_prev_button_pos =      {20, 215, 30, 25};
+            std::array<int, 4> patch_next_button_pos =      {55, 215, 30, 25};
+            std::array<int, 4> patch_label_pos =            {90, 215, 260, 25};
+            std::array<int, 4> patch_save_button_pos =      {355, 215, 75, 25};
+
+            std::array<int, 4> delay_time_dial_pos =        {20, 260, 50, 50};
+            std::array<int, 4> delay_feedback_dial_pos =    {80, 260, 50, 50};
+            std::array<int, 4> delay_mix_dial_pos =         {140, 260, 50, 50};
+            std::array<int, 4> reverb_time_dial_pos =       {250, 260, 50, 50};
+            std::array<int, 4> reverb_damping_dial_pos =    {310, 260, 50, 50};
+            std::array<int, 4> reverb_mix_dial_pos =        {370, 260, 50, 50};
+            std::array<int, 4> unison_voices_dial_pos =     {480, 260, 50, 50};
+            std::array<int, 4> unison_detune_dial_pos =     {540, 260, 50, 50};
+            std::array<int, 4> unison_spread_dial_pos =     {600, 260, 50, 50};
+
             begin();
 
             // Create widgets using positions, dimensions, and min/max values
-            attack_dial = new MyVerticalDial(attack_dial_pos[0], attack_dial_pos[1], attack_dial_pos[2], attack_dial_pos[3], attack_min_max_set[0], attack_min_max_set[1], "Attack");
-            decay_dial = new MyVerticalDial(decay_dial_pos[0], decay_dial_pos[1], decay_dial_pos[2], decay_dial_pos[3], decay_min_max_set[0], decay_min_max_set[1], "Decay");
-            sustain_dial = new MyVerticalDial(sustain_dial_pos[0], sustain_dial_pos[1], sustain_dial_pos[2], sustain_dial_pos[3], sustain_min_max_set[0], sustain_min_max_set[1], "Sustain");
-            release_dial = new MyVerticalDial(release_dial_pos[0], release_dial_pos[1], release_dial_pos[2], release_dial_pos[3], release_min_max_set[0], release_min_max_set[1], "Release");
+            attack_dial = new MyVerticalDial(attack_dial_pos[0], attack_dial_pos[1], attack_dial_pos[2], attack_dial_pos[3], param_info(PARAM_ATTACK).min, param_info(PARAM_ATTACK).max, "Attack");
+            decay_dial = new MyVerticalDial(decay_dial_pos[0], decay_dial_pos[1], decay_dial_pos[2], decay_dial_pos[3], param_info(PARAM_DECAY).min, param_info(PARAM_DECAY).max, "Decay");
+            sustain_dial = new MyVerticalDial(sustain_dial_pos[0], sustain_dial_pos[1], sustain_dial_pos[2], sustain_dial_pos[3], param_info(PARAM_SUSTAIN).min, param_info(PARAM_SUSTAIN).max, "Sustain");
+            release_dial = new MyVerticalDial(release_dial_pos[0], release_dial_pos[1], release_dial_pos[2], release_dial_pos[3], param_info(PARAM_RELEASE).min, param_info(PARAM_RELEASE).max, "Release");
 
             transpose_up_button = new Fl_Button(transpose_up_button_pos[0], transpose_up_button_pos[1], transpose_up_button_pos[2], transpose_up_button_pos[3], "+");
             transpose_down_button = new Fl_Button(transpose_down_button_pos[0], transpose_down_button_pos[1], transpose_down_button_pos[2], transpose_down_button_pos[3], "-");
 
-            sine_dial = new MyVerticalDial(sine_dial_pos[0], sine_dial_pos[1], sine_dial_pos[2], sine_dial_pos[3], wave_min_max_set[0], wave_min_max_set[1], "Sine");
-            saw_dial = new MyVerticalDial(saw_dial_pos[0], saw_dial_pos[1], saw_dial_pos[2], saw_dial_pos[3], wave_min_max_set[0], wave_min_max_set[1], "Saw");
-            square_dial = new MyVerticalDial(square_dial_pos[0], square_dial_pos[1], square_dial_pos[2], square_dial_pos[3], wave_min_max_set[0], wave_min_max_set[1], "Square");
+            sine_dial = new MyVerticalDial(sine_dial_pos[0], sine_dial_pos[1], sine_dial_pos[2], sine_dial_pos[3], param_info(PARAM_SIN).min, param_info(PARAM_SIN).max, "Sine");
+            saw_dial = new MyVerticalDial(saw_dial_pos[0], saw_dial_pos[1], saw_dial_pos[2], saw_dial_pos[3], param_info(PARAM_SAW).min, param_info(PARAM_SAW).max, "Saw");
+            square_dial = new MyVerticalDial(square_dial_pos[0], square_dial_pos[1], square_dial_pos[2], square_dial_pos[3], param_info(PARAM_SQUARE).min, param_info(PARAM_SQUARE).max, "Square");
+
+            filter_cutoff_dial = new MyVerticalDial(cutoff_dial_pos[0], cutoff_dial_pos[1], cutoff_dial_pos[2], cutoff_dial_pos[3], param_info(PARAM_CUTOFF).min, param_info(PARAM_CUTOFF).max, "Cutoff");
+            filter_Q_dial = new MyVerticalDial(Q_dial_pos[0], Q_dial_pos[1], Q_dial_pos[2], Q_dial_pos[3], param_info(PARAM_Q).min, param_info(PARAM_Q).max, "Q");
 
-            filter_cutoff_dial = new MyVerticalDial(cutoff_dial_pos[0], cutoff_dial_pos[1], cutoff_dial_pos[2], cutoff_dial_pos[3], cutoff_min_max_set[0], cutoff_min_max_set[1], "Cutoff");
-            filter_Q_dial = new MyVerticalDial(Q_dial_pos[0], Q_dial_pos[1], Q_dial_pos[2], Q_dial_pos[3], Q_min_max_set[0], Q_min_max_set[1], "Q");
+            vol_lfo_freq_dial = new MyVerticalDial(vol_lfo_freq_dial_pos[0], vol_lfo_freq_dial_pos[1], vol_lfo_freq_dial_pos[2], vol_lfo_freq_dial_pos[3], param_info(PARAM_VOL_LFO_FREQUENCY).min, param_info(PARAM_VOL_LFO_FREQUENCY).max, "Frequency");
+            vol_lfo_amp_dial = new MyVerticalDial(vol_lfo_amp_dial_pos[0], vol_lfo_amp_dial_pos[1], vol_lfo_amp_dial_pos[2], vol_lfo_amp_dial_pos[3], param_info(PARAM_VOL_LFO_AMPLITUDE).min, param_info(PARAM_VOL_LFO_AMPLITUDE).max, "Amplitude");
 
-            vol_lfo_freq_dial = new MyVerticalDial(vol_lfo_freq_dial_pos[0], vol_lfo_freq_dial_pos[1], vol_lfo_freq_dial_pos[2], vol_lfo_freq_dial_pos[3], lfo_freq_min_max_set[0], lfo_freq_min_max_set[1], "Frequency");
-            vol_lfo_amp_dial = new MyVerticalDial(vol_lfo_amp_dial_pos[0], vol_lfo_amp_dial_pos[1], vol_lfo_amp_dial_pos[2], vol_lfo_amp_dial_pos[3], lfo_amp_min_max_set[0], lfo_amp_min_max_set[1], "Amplitude");
+            cutoff_lfo_freq_dial = new MyVerticalDial(cutoff_lfo_freq_dial_pos[0], cutoff_lfo_freq_dial_pos[1], cutoff_lfo_freq_dial_pos[2], cutoff_lfo_freq_dial_pos[3], param_info(PARAM_CUTOFF_LFO_FREQUENCY).min, param_info(PARAM_CUTOFF_LFO_FREQUENCY).max, "Frequency");
+            cutoff_lfo_amp_dial = new MyVerticalDial(cutoff_lfo_amp_dial_pos[0], cutoff_lfo_amp_dial_pos[1], cutoff_lfo_amp_dial_pos[2], cutoff_lfo_amp_dial_pos[3], param_info(PARAM_CUTOFF_LFO_AMPLITUDE).min, param_info(PARAM_CUTOFF_LFO_AMPLITUDE).max, "Amplitude");
 
-            cutoff_lfo_freq_dial = new MyVerticalDial(cutoff_lfo_freq_dial_pos[0], cutoff_lfo_freq_dial_pos[1], cutoff_lfo_freq_dial_pos[2], cutoff_lfo_freq_dial_pos[3], cutoff_lfo_freq_min_max_set[0], cutoff_lfo_freq_min_max_set[1], "Frequency");
-            cutoff_lfo_amp_dial = new MyVerticalDial(cutoff_lfo_amp_dial_pos[0], cutoff_lfo_amp_dial_pos[1], cutoff_lfo_amp_dial_pos[2], cutoff_lfo_amp_dial_pos[3], cutoff_lfo_amp_min_max_set[0], cutoff_lfo_amp_min_max_set[1], "Amplitude");
+            delay_time_dial = new MyVerticalDial(delay_time_dial_pos[0], delay_time_dial_pos[1], delay_time_dial_pos[2], delay_time_dial_pos[3], param_info(PARAM_DELAY_TIME).min, param_info(PARAM_DELAY_TIME).max, "Delay");
+            delay_feedback_dial = new MyVerticalDial(delay_feedback_dial_pos[0], delay_feedback_dial_pos[1], delay_feedback_dial_pos[2], delay_feedback_dial_pos[3], param_info(PARAM_DELAY_FEEDBACK).min, param_info(PARAM_DELAY_FEEDBACK).max, "Feedback");
+            delay_mix_dial = new MyVerticalDial(delay_mix_dial_pos[0], delay_mix_dial_pos[1], delay_mix_dial_pos[2], delay_mix_dial_pos[3], param_info(PARAM_DELAY_MIX).min, param_info(PARAM_DELAY_MIX).max, "Mix");
+
+            reverb_time_dial = new MyVerticalDial(reverb_time_dial_pos[0], reverb_time_dial_pos[1], reverb_time_dial_pos[2], reverb_time_dial_pos[3], param_info(PARAM_REVERB_TIME).min, param_info(PARAM_REVERB_TIME).max, "Reverb");
+            reverb_damping_dial = new MyVerticalDial(reverb_damping_dial_pos[0], reverb_damping_dial_pos[1], reverb_damping_dial_pos[2], reverb_damping_dial_pos[3], param_info(PARAM_REVERB_DAMPING).min, param_info(PARAM_REVERB_DAMPING).max, "Damping");
+            reverb_mix_dial = new MyVerticalDial(reverb_mix_dial_pos[0], reverb_mix_dial_pos[1], reverb_mix_dial_pos[2], reverb_mix_dial_pos[3], param_info(PARAM_REVERB_MIX).min, param_info(PARAM_REVERB_MIX).max, "Mix");
+
+            unison_voices_dial = new MyVerticalDial(unison_voices_dial_pos[0], unison_voices_dial_pos[1], unison_voices_dial_pos[2], unison_voices_dial_pos[3], param_info(PARAM_UNISON_VOICES).min, param_info(PARAM_UNISON_VOICES).max, "Unison");
+            unison_detune_dial = new MyVerticalDial(unison_detune_dial_pos[0], unison_detune_dial_pos[1], unison_detune_dial_pos[2], unison_detune_dial_pos[3], param_info(PARAM_UNISON_DETUNE).min, param_info(PARAM_UNISON_DETUNE).max, "Detune");
+            unison_spread_dial = new MyVerticalDial(unison_spread_dial_pos[0], unison_spread_dial_pos[1], unison_spread_dial_pos[2], unison_spread_dial_pos[3], param_info(PARAM_UNISON_SPREAD).min, param_info(PARAM_UNISON_SPREAD).max, "Spread");
+
+            cpu_meter = new Fl_Progress(cpu_meter_pos[0], cpu_meter_pos[1], cpu_meter_pos[2], cpu_meter_pos[3]);
+            dump_telemetry_button = new Fl_Button(dump_telemetry_button_pos[0], dump_telemetry_button_pos[1], dump_telemetry_button_pos[2], dump_telemetry_button_pos[3], "Dump CPU");
+            oversampling_button = new Fl_Button(oversampling_button_pos[0], oversampling_button_pos[1], oversampling_button_pos[2], oversampling_button_pos[3], "OS 1x");
+            part_button = new Fl_Button(part_button_pos[0], part_button_pos[1], part_button_pos[2], part_button_pos[3], part_label);
+            record_button = new Fl_Button(record_button_pos[0], record_button_pos[1], record_button_pos[2], record_button_pos[3], "Rec");
+
+            patch_prev_button = new Fl_Button(patch_prev_button_pos[0], patch_prev_button_pos[1], patch_prev_button_pos[2], patch_prev_button_pos[3], "<");
+            patch_next_button = new Fl_Button(patch_next_button_pos[0], patch_next_button_pos[1], patch_next_button_pos[2], patch_next_button_pos[3], ">");
+            patch_label = new Fl_Box(patch_label_pos[0], patch_label_pos[1], patch_label_pos[2], patch_label_pos[3], patch_label_text);
+            patch_save_button = new Fl_Button(patch_save_button_pos[0], patch_save_button_pos[1], patch_save_button_pos[2], patch_save_button_pos[3], "Save");
 
             end();
 
+            param_dials[PARAM_ATTACK] = attack_dial;
+            param_dials[PARAM_DECAY] = decay_dial;
+            param_dials[PARAM_SUSTAIN] = sustain_dial;
+            param_dials[PARAM_RELEASE] = release_dial;
+            param_dials[PARAM_VOL_LFO_FREQUENCY] = vol_lfo_freq_dial;
+            param_dials[PARAM_VOL_LFO_AMPLITUDE] = vol_lfo_amp_dial;
+            param_dials[PARAM_CUTOFF_LFO_FREQUENCY] = cutoff_lfo_freq_dial;
+            param_dials[PARAM_CUTOFF_LFO_AMPLITUDE] = cutoff_lfo_amp_dial;
+            param_dials[PARAM_SIN] = sine_dial;
+            param_dials[PARAM_SAW] = saw_dial;
+            param_dials[PARAM_SQUARE] = square_dial;
+            param_dials[PARAM_CUTOFF] = filter_cutoff_dial;
+            param_dials[PARAM_Q] = filter_Q_dial;
+            param_dials[PARAM_DELAY_TIME] = delay_time_dial;
+            param_dials[PARAM_DELAY_FEEDBACK] = delay_feedback_dial;
+            param_dials[PARAM_DELAY_MIX] = delay_mix_dial;
+            param_dials[PARAM_REVERB_TIME] = reverb_time_dial;
+            param_dials[PARAM_REVERB_DAMPING] = reverb_damping_dial;
+            param_dials[PARAM_REVERB_MIX] = reverb_mix_dial;
+            param_dials[PARAM_UNISON_VOICES] = unison_voices_dial;
+            param_dials[PARAM_UNISON_DETUNE] = unison_detune_dial;
+            param_dials[PARAM_UNISON_SPREAD] = unison_spread_dial;
+
+            cpu_meter->minimum(0);
+            cpu_meter->maximum(1);
+            cpu_meter->value(0);
+            cpu_meter->selection_color(FL_GREEN);
+
             // Set initial values for the widgets
-            attack_dial->value(attack_min_max_set[2]);
-            decay_dial->value(decay_min_max_set[2]);
-            sustain_dial->value(sustain_min_max_set[2]);
-            release_dial->value(release_min_max_set[2]);
-            vol_lfo_freq_dial->value(lfo_freq_min_max_set[2]);
-            vol_lfo_amp_dial->value(lfo_amp_min_max_set[2]);
-            cutoff_lfo_freq_dial->value(cutoff_lfo_freq_min_max_set[2]);
-            cutoff_lfo_amp_dial->value(cutoff_lfo_amp_min_max_set[2]);
-            sine_dial->value(wave_min_max_set[2]);
-            saw_dial->value(wave_min_max_set[2]);
-            square_dial->value(wave_min_max_set[2]);
-            filter_cutoff_dial->value(cutoff_min_max_set[2]);
-            filter_Q_dial->value(Q_min_max_set[2]);
+            for (int i = 0; i < PARAM_COUNT; ++i) {
+                if (param_dials[i] != nullptr) {
+                    param_dials[i]->value(params.get(static_cast<ParamId>(i)));
+                }
+            }
 
             // Set the callbacks
             attack_dial->callback(dial_cb, (void*)this);
@@ -161,6 +262,16 @@ class MyWindow : public Fl_Window {
             release_dial->callback(dial_cb, (void*)this);
             transpose_up_button->callback(button_transpose_up_cb, (void*)this);
             transpose_down_button->callback(button_transpose_down_cb, (void*)this);
+            dump_telemetry_button->callback(button_dump_telemetry_cb, (void*)this);
+            oversampling_button->callback(button_oversampling_cb, (void*)this);
+            part_button->callback(button_part_cb, (void*)this);
+            record_button->callback(button_record_cb, (void*)this);
+            patch_prev_button->callback(button_patch_prev_cb, (void*)this);
+            patch_next_button->callback(button_patch_next_cb, (void*)this);
+            patch_save_button->callback(button_patch_save_cb, (void*)this);
+            Fl::add_timeout(CPU_METER_INTERVAL, cpu_meter_cb, (void*)this);
+            Fl::add_timeout(OSC_POLL_INTERVAL, osc_poll_cb, (void*)this);
+            Fl::add_timeout(PARAM_PUBLISH_INTERVAL, param_publish_cb, (void*)this);
             vol_lfo_freq_dial->callback(dial_cb, (void*)this);
             vol_lfo_amp_dial->callback(dial_cb, (void*)this);
             cutoff_lfo_freq_dial->callback(dial_cb, (void*)this);
@@ -170,6 +281,15 @@ class MyWindow : public Fl_Window {
             square_dial->callback(dial_cb, (void*)this);
             filter_cutoff_dial->callback(dial_cb, (void*)this);
             filter_Q_dial->callback(dial_cb, (void*)this);
+            delay_time_dial->callback(dial_cb, (void*)this);
+            delay_feedback_dial->callback(dial_cb, (void*)this);
+            delay_mix_dial->callback(dial_cb, (void*)this);
+            reverb_time_dial->callback(dial_cb, (void*)this);
+            reverb_damping_dial->callback(dial_cb, (void*)this);
+            reverb_mix_dial->callback(dial_cb, (void*)this);
+            unison_voices_dial->callback(dial_cb, (void*)this);
+            unison_detune_dial->callback(dial_cb, (void*)this);
+            unison_spread_dial->callback(dial_cb, (void*)this);
 
             // Style Aesthetic
             attack_dial->type(FL_FILL_DIAL);
@@ -186,28 +306,42 @@ class MyWindow : public Fl_Window {
             filter_cutoff_dial->type(FL_FILL_DIAL);
             filter_Q_dial->type(FL_FILL_DIAL);
 
-            // Set initial values using the 'set' values from min_max_set arrays
-            set_filter(cutoff_min_max_set[2], Q_min_max_set[2]);
-            set_envelope(attack_min_max_set[2], decay_min_max_set[2], sustain_min_max_set[2], release_min_max_set[2]);
-            set_LFO(lfo_freq_min_max_set[2], lfo_amp_min_max_set[2]);
-            set_waveform(wave_min_max_set[2], wave_min_max_set[2], wave_min_max_set[2]);  // Assuming sine, saw, and square use the same set value
-            set_cutoff_lfo(cutoff_lfo_freq_min_max_set[2], cutoff_lfo_amp_min_max_set[2]);
+            // every part starts on the registry defaults
+            for (size_t i = 0; i < mixer.part_count(); ++i) {
+                params.dirty = (1u << PARAM_COUNT) - 1;
+                publish_params(mixer.part(i));
+            }
 
             octave_scale = 1000;
             set_keymap();
+
+            // the dials above stay in charge until a patch is picked
+            if (access(PATCH_BANK_PATH, F_OK) == 0) {
+                open_patch_bank(PATCH_BANK_PATH, bank);
+            }
+            update_patch_label();
         }
 
+        ~MyWindow() override {
+            close_patch_bank(bank);
+        }
+
+    // the part the dials and keyboard are on
+    SynthEngine &engine() {
+        return mixer.part(part);
+    }
+
     int handle(int event) override {
         switch (event) {
             int key;
             case FL_KEYDOWN:  // keyboard key pressed
                 key = Fl::event_key();
                 //spdlog::debug("{} pressed, mapped to : {}", key, key_remap[key]);
-                note_on(key_remap[key], 128);
+                engine().note_on(key_remap[key], 128);
                 return Fl_Window::handle(event);
             case FL_KEYUP:    // keyboard key released
                 key = Fl::event_key();
-                note_off(key_remap[key]);
+                engine().note_off(key_remap[key]);
                 return Fl_Window::handle(event);
         }
         return Fl_Window::handle(event);
@@ -225,6 +359,291 @@ class MyWindow : public Fl_Window {
         window->set_keymap();
     }
 
+    // cycles 1x -> 2x -> 4x, the CPU meter shows what each one costs
+    static void button_oversampling_cb(Fl_Widget *w, void *data) {
+        MyWindow *window = static_cast<MyWindow*>(data);
+        window->oversampling = window->oversampling >= 4 ? 1 : window->oversampling * 2;
+        for (size_t i = 0; i < window->mixer.part_count(); ++i) {
+            window->mixer.part(i).set_oversampling(window->oversampling);
+        }
+        window->oversampling_button->label(window->oversampling == 1 ? "OS 1x" : window->oversampling == 2 ? "OS 2x" : "OS 4x");
+    }
+
+    // Moves the dials and keyboard to the next part. Whatever is held on the old
+    // one is released, its key up would go to the new part
+    static void button_part_cb(Fl_Widget *w, void *data) {
+        MyWindow *window = static_cast<MyWindow*>(data);
+        window->publish_params(window->engine());
+        int highest = *std::max_element(window->key_remap.begin(), window->key_remap.end());
+        for (int key = 0; key <= highest; ++key) {
+            window->engine().note_off(key);
+        }
+        window->part = (window->part + 1) % window->mixer.part_count();
+        snprintf(window->part_label, sizeof(window->part_label), "Part %zu", window->part + 1);
+        window->part_button->label(window->part_label);
+        window->show_patch(window->engine().get_patch());
+    }
+
+    static void button_record_cb(Fl_Widget *w, void *data) {
+        MyWindow *window = static_cast<MyWindow*>(data);
+        // flush what the dials hold so the recording starts (or ends) with it
+        window->publish_params(window->engine());
+        if (window->recording_on) {
+            window->drain_recording();
+            std::stable_sort(window->recording.events.begin(), window->recording.events.end(),
+                             [](const RecordedEvent &a, const RecordedEvent &b) { return a.frame < b.frame; });
+            if (write_recording(RECORDING_PATH, window->recording)) {
+                spdlog::info("{} events recorded to {}", window->recording.events.size(), RECORDING_PATH);
+            }
+            window->recording.events.clear();
+        } else {
+            window->drain_recording();  // leftovers from the last one
+            window->recording.sample_rate_kHz = window->engine().get_sample_rate();
+        }
+        window->recording_on = !window->recording_on;
+        for (size_t i = 0; i < window->mixer.part_count(); ++i) {
+            window->mixer.part(i).set_recording(window->recording_on);
+        }
+        window->record_button->label(window->recording_on ? "Stop" : "Rec");
+    }
+
+    // Collects what the parts recorded since last time. Whatever the audio
+    // thread still logs after Stop turns up here later and is dropped
+    void drain_recording() {
+        for (size_t i = 0; i < mixer.part_count(); ++i) {
+            RecordedEvent event;
+            while (mixer.part(i).pop_recorded_event(event)) {
+                event.part = static_cast<uint8_t>(i);
+                if (recording_on) {
+                    recording.events.push_back(event);
+                }
+            }
+        }
+    }
+
+    static void button_patch_prev_cb(Fl_Widget *w, void *data) {
+        MyWindow *window = static_cast<MyWindow*>(data);
+        if (window->bank.count > 0) {
+            window->select_patch((window->patch_index + window->bank.count - 1) % window->bank.count);
+        }
+    }
+
+    static void button_patch_next_cb(Fl_Widget *w, void *data) {
+        MyWindow *window = static_cast<MyWindow*>(data);
+        if (window->bank.count > 0) {
+            window->select_patch((window->patch_index + 1) % window->bank.count);
+        }
+    }
+
+    // appends the current sound to the bank as a new patch
+    static void button_patch_save_cb(Fl_Widget *w, void *data) {
+        MyWindow *window = static_cast<MyWindow*>(data);
+        std::vector<Patch> patches(window->bank.count);
+        for (size_t i = 0; i < patches.size(); ++i) {
+            read_patch(window->bank, i, patches[i]);
+        }
+        window->publish_params(window->engine());
+        Patch patch = window->engine().get_patch();
+        snprintf(patch.name, sizeof(patch.name), "Patch %zu", patches.size() + 1);
+        patches.push_back(patch);
+        if (write_patch_bank(PATCH_BANK_PATH, patches) && open_patch_bank(PATCH_BANK_PATH, window->bank)) {
+            window->patch_index = patches.size() - 1;
+        }
+        window->update_patch_label();
+    }
+
+    // Program change: the dials jump to the patch without firing their
+    // callbacks and the engine gets the whole patch in one go
+    void select_patch(size_t index) {
+        Patch patch;
+        if (!read_patch(bank, index, patch)) {
+            return;
+        }
+        patch_index = index;
+        engine().load_patch(patch);
+        show_patch(patch);
+        update_patch_label();
+    }
+
+    // point the dials at patch, without touching the engine. Anything still
+    // waiting to be published is dropped, the patch replaces it
+    void show_patch(const Patch &patch) {
+        for (int i = 0; i < PARAM_COUNT; ++i) {
+            ParamId id = static_cast<ParamId>(i);
+            params.assign(id, get_patch_param(patch, id));
+            if (param_dials[i] != nullptr) {
+                param_dials[i]->value(params.get(id));
+            }
+        }
+        params.dirty = 0;
+        redraw();
+    }
+
+    void update_patch_label() {
+        if (bank.count == 0) {
+            snprintf(patch_label_text, sizeof(patch_label_text), "no patch bank");
+        } else {
+            Patch patch;
+            read_patch(bank, patch_index, patch);
+            snprintf(patch_label_text, sizeof(patch_label_text), "%zu: %.*s", patch_index + 1,
+                     static_cast<int>(strnlen(patch.name, PATCH_NAME_LENGTH)), patch.name);
+        }
+        patch_label->label(patch_label_text);
+        patch_label->redraw();
+    }
+
+    static void button_dump_telemetry_cb(Fl_Widget *w, void *data) {
+        dump_telemetry("synth_telemetry.txt");
+    }
+
+    // refresh the CPU meter from the last telemetry window
+    static void cpu_meter_cb(void *data) {
+        MyWindow *window = static_cast<MyWindow*>(data);
+        LoadSummary load = get_recent_load();
+        LoadSummary total = get_total_load();
+        OscLatencySummary osc = get_osc_latency();
+        int n = snprintf(window->cpu_meter_label, sizeof(window->cpu_meter_label),
+                         "CPU %.0f%% p99 %.0f%% max %.0f%% xruns %llu",
+                         load.avg * 100, load.p99 * 100, load.max * 100, total.output_underflows);
+        if (osc.rendered > 0 && n > 0 && n < static_cast<int>(sizeof(window->cpu_meter_label))) {
+            snprintf(window->cpu_meter_label + n, sizeof(window->cpu_meter_label) - n,
+                     " OSC p99 %.1f ms", osc.p99_ms);
+        }
+        window->cpu_meter->value(std::min(load.p99, 1.0f));
+        window->cpu_meter->selection_color(load.p99 < 0.7f ? FL_GREEN : load.p99 < 0.9f ? FL_YELLOW : FL_RED);
+        window->cpu_meter->label(window->cpu_meter_label);
+        Fl::repeat_timeout(CPU_METER_INTERVAL, cpu_meter_cb, data);
+    }
+
+    // parameter changes from the OSC server: move the dials and republish
+    // everything from them, same as turning them by hand
+    static void osc_poll_cb(void *data) {
+        MyWindow *window = static_cast<MyWindow*>(data);
+        OscParamMessage message;
+        bool dials_changed = false;
+        while (pop_osc_param(message)) {
+            if (message.part >= window->mixer.part_count()) {
+                continue;
+            }
+            if (message.part != window->part) {
+                window->apply_to_hidden_part(message);
+                continue;
+            }
+            const std::array<float, 4> &a = message.args;
+            switch (message.type) {
+                case OSC_ENVELOPE:
+                    window->attack_dial->value(a[0]);
+                    window->decay_dial->value(a[1]);
+                    window->sustain_dial->value(a[2]);
+                    window->release_dial->value(a[3]);
+                    break;
+                case OSC_LFO:
+                    window->vol_lfo_freq_dial->value(a[0]);
+                    window->vol_lfo_amp_dial->value(a[1]);
+                    break;
+                case OSC_CUTOFF_LFO:
+                    window->cutoff_lfo_freq_dial->value(a[0]);
+                    window->cutoff_lfo_amp_dial->value(a[1]);
+                    break;
+                case OSC_WAVEFORM:
+                    window->sine_dial->value(a[0]);
+                    window->saw_dial->value(a[1]);
+                    window->square_dial->value(a[2]);
+                    break;
+                case OSC_FILTER:
+                    window->filter_cutoff_dial->value(a[0]);
+                    window->filter_Q_dial->value(a[1]);
+                    break;
+                case OSC_POLYPHONY:
+                    window->engine().set_polyphony(static_cast<unsigned>(std::max(1.0f, a[0])),
+                                                   static_cast<StealPolicy>(std::clamp(static_cast<int>(a[1]), 0, 2)));
+                    continue;
+                case OSC_PROGRAM:
+                    window->select_patch(static_cast<size_t>(std::max(0.0f, a[0])));
+                    continue;
+                case OSC_PARAM: {
+                    ParamId id = static_cast<ParamId>(a[0]);
+                    window->params.set(id, a[1]);
+                    if (window->param_dials[id] != nullptr) {
+                        window->param_dials[id]->value(window->params.get(id));
+                        window->param_dials[id]->redraw();
+                    }
+                    continue;
+                }
+            }
+            dials_changed = true;
+        }
+        if (dials_changed) {
+            window->redraw();
+            for (int i = 0; i < PARAM_COUNT; ++i) {
+                if (window->param_dials[i] != nullptr) {
+                    window->params.set(static_cast<ParamId>(i), window->param_dials[i]->value());
+                }
+            }
+        }
+        Fl::repeat_timeout(OSC_POLL_INTERVAL, osc_poll_cb, data);
+    }
+
+    // OSC parameters for a part the dials aren't showing go straight to its
+    // engine, as registry changes so they get clamped just like the dials' do
+    void apply_to_hidden_part(const OscParamMessage &message) {
+        SynthEngine &target = mixer.part(message.part);
+        const std::array<float, 4> &a = message.args;
+        std::array<ParamChange, 4> changes;
+        size_t count = 0;
+        auto change = [&](ParamId id, float value) {
+            changes[count++] = {id, clamp_param(id, value)};
+        };
+        switch (message.type) {
+            case OSC_ENVELOPE:
+                change(PARAM_ATTACK, a[0]);
+                change(PARAM_DECAY, a[1]);
+                change(PARAM_SUSTAIN, a[2]);
+                change(PARAM_RELEASE, a[3]);
+                break;
+            case OSC_LFO:
+                change(PARAM_VOL_LFO_FREQUENCY, a[0]);
+                change(PARAM_VOL_LFO_AMPLITUDE, a[1]);
+                break;
+            case OSC_CUTOFF_LFO:
+                change(PARAM_CUTOFF_LFO_FREQUENCY, a[0]);
+                change(PARAM_CUTOFF_LFO_AMPLITUDE, a[1]);
+                break;
+            case OSC_WAVEFORM: {
+                change(PARAM_SIN, a[0]);
+                change(PARAM_SAW, a[1]);
+                change(PARAM_SQUARE, a[2]);
+                // relative weights, normalized as publish_params() does
+                float total = std::max(changes[0].value + changes[1].value + changes[2].value, 1.0f);
+                for (size_t i = 0; i < count; ++i) {
+                    changes[i].value /= total;
+                }
+                break;
+            }
+            case OSC_FILTER:
+                change(PARAM_CUTOFF, a[0]);
+                change(PARAM_Q, a[1]);
+                break;
+            case OSC_POLYPHONY:
+                target.set_polyphony(static_cast<unsigned>(std::max(1.0f, a[0])),
+                                     static_cast<StealPolicy>(std::clamp(static_cast<int>(a[1]), 0, 2)));
+                break;
+            case OSC_PROGRAM: {
+                Patch patch;
+                if (read_patch(bank, static_cast<size_t>(std::max(0.0f, a[0])), patch)) {
+                    target.load_patch(patch);
+                }
+                break;
+            }
+            case OSC_PARAM:
+                change(static_cast<ParamId>(a[0]), a[1]);
+                break;
+        }
+        if (count > 0) {
+            target.set_params({changes.data(), count});
+        }
+    }
+
     void set_keymap() {
         std::array<float, 256> key_note_map = {};
         key_note_map[0] = 261.63/octave_scale;  // C
@@ -237,61 +656,128 @@ class MyWindow : public Fl_Window {
         key_note_map[7] = 523.25/octave_scale;  // C
         key_note_map[8] = 587.33/octave_scale;  // D
         key_note_map[9] = 659.25/octave_scale;  // E
-        set_key_freq_map(key_note_map);
+        for (size_t i = 0; i < mixer.part_count(); ++i) {
+            mixer.part(i).set_key_freq_map(key_note_map);
+        }
     }
 
+    // a dial only marks its parameter changed, param_publish_cb() sends it on
     static void dial_cb(Fl_Widget *w, void *data) {
         MyWindow *win = (MyWindow *)data;
-        float attack = win->attack_dial->value();
-        float decay = win->decay_dial->value();
-        float sustain = win->sustain_dial->value();
-        float release = win->release_dial->value();
-        float lfo_freq = win->vol_lfo_freq_dial->value();
-        float lfo_amp = win->vol_lfo_amp_dial->value();
-        float cutoff_lfo_freq = win->cutoff_lfo_freq_dial->value();
-        float cutoff_lfo_amp = win->cutoff_lfo_amp_dial->value();
-        float sine_val = win->sine_dial->value();
-        float saw_val = win->saw_dial->value();
-        float square_val = win->square_dial->value();
-        float cutoff = win->filter_cutoff_dial->value();
-        float Q = win->filter_Q_dial->value();
-
-        float total = std::max(sine_val + saw_val + square_val, 1.0f);
-        float p_sin = sine_val / total;
-        float p_saw = saw_val / total;
-        float p_square = square_val / total;
-
-        set_filter(cutoff, Q);
-        set_envelope(attack, decay, sustain, release);
-        set_LFO(lfo_freq, lfo_amp);
-        set_waveform(p_sin, p_saw, p_square);
-        set_cutoff_lfo(cutoff_lfo_freq, cutoff_lfo_amp);
+        for (int i = 0; i < PARAM_COUNT; ++i) {
+            if (win->param_dials[i] == w) {
+                win->params.set(static_cast<ParamId>(i), win->param_dials[i]->value());
+            }
+        }
+    }
+
+    // Sends the parameters changed since last time to target, in one snapshot.
+    // The waveform dials are relative weights, so moving any of them sends all
+    // three normalized.
+    void publish_params(SynthEngine &target) {
+        if (params.dirty & WAVE_PARAMS) {
+            params.dirty |= WAVE_PARAMS;
+        }
+        std::array<ParamChange, PARAM_COUNT> changes;
+        size_t count = params.take_changes(changes);
+        if (count == 0) {
+            return;
+        }
+        float total = std::max(params.get(PARAM_SIN) + params.get(PARAM_SAW) + params.get(PARAM_SQUARE), 1.0f);
+        for (size_t i = 0; i < count; ++i) {
+            if (WAVE_PARAMS & (1u << changes[i].id)) {
+                changes[i].value /= total;
+            }
+        }
+        target.set_params({changes.data(), count});
+    }
+
+    static void param_publish_cb(void *data) {
+        MyWindow *window = static_cast<MyWindow*>(data);
+        window->publish_params(window->engine());
+        window->drain_recording();
+        Fl::repeat_timeout(PARAM_PUBLISH_INTERVAL, param_publish_cb, data);
     }
 };
 
-int main() {
+static void usage() {
+    spdlog::error("usage: Synth [--list-devices] [--device <index|name>] [--rate <Hz>] [--buffer <frames>] [--low-latency]");
+}
+
+int main(int argc, char **argv) {
     spdlog::set_level(spdlog::level::debug);
     spdlog::debug("speedlog test!!");
     PaError err = Pa_Initialize();
     if (err != paNoError){ return 1; }
 
-    PaStream *stream;
-    err = Pa_OpenDefaultStream(&stream,
-                               0,
-                               2,
-                               paFloat32,
-                               SAMPLERATE_kHz*1000,
-                               256,
-                               audioCallback,
-                               nullptr);
-    if (err != paNoError){ return 1; }
+    // --low-latency on its own also drops the buffer to 64 frames
+    AudioConfig config;
+    bool buffer_given = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--list-devices") {
+            list_audio_devices();
+            Pa_Terminate();
+            return 0;
+        } else if (arg == "--device" && i + 1 < argc) {
+            config.device = find_audio_device(argv[++i]);
+            if (config.device < 0) {
+                spdlog::error("no output device '{}', see --list-devices", argv[i]);
+                Pa_Terminate();
+                return 1;
+            }
+        } else if (arg == "--rate" && i + 1 < argc) {
+            config.sample_rate_kHz = std::strtof(argv[++i], nullptr) / 1000;
+        } else if (arg == "--buffer" && i + 1 < argc) {
+            config.buffer_frames = std::strtoul(argv[++i], nullptr, 10);
+            buffer_given = true;
+        } else if (arg == "--low-latency") {
+            config.low_latency = true;
+        } else {
+            usage();
+            Pa_Terminate();
+            return 1;
+        }
+    }
+    if (config.sample_rate_kHz < MIN_SAMPLERATE_kHz || config.sample_rate_kHz > MAX_SAMPLERATE_kHz) {
+        spdlog::error("--rate must be {:.0f}..{:.0f} Hz", MIN_SAMPLERATE_kHz * 1000, MAX_SAMPLERATE_kHz * 1000);
+        Pa_Terminate();
+        return 1;
+    }
+    if (config.low_latency && !buffer_given) {
+        config.buffer_frames = 64;
+    }
+
+    start_telemetry();
+    // one worker per spare core for rendering big voice counts
+    unsigned cores = std::thread::hardware_concurrency();
+    start_workers(cores > 1 ? cores - 1 : 0);
+    // four parts, each with its own patch, rendered side by side on the workers
+    Mixer mixer(4);
+    start_osc_server(DEFAULT_OSC_PORT, mixer);  // carries on without it if the port is taken
+
+    AudioStreamInfo stream_info;
+    PaStream *stream = open_audio_stream(config, mixer, stream_info);
+    if (stream == nullptr){ return 1; }
     err = Pa_StartStream(stream);
     if (err != paNoError){ return 1; }
 
-    MyWindow *window = new MyWindow(750, 250);
+    MyWindow *window = new MyWindow(750, 330, mixer);
+    // what the stream actually runs at, in the title bar
+    char title[96];
+    snprintf(title, sizeof(title), "Synth - %.0f Hz, %lu frames, %.1f ms out", stream_info.sample_rate_kHz * 1000,
+             stream_info.buffer_frames, stream_info.output_latency_ms);
+    window->label(title);
 
     window->end();
     window->show();
 
-    return Fl::run();
+    int result = Fl::run();
+    // the callback uses the workers and the mixer, so stop it before they go away
+    Pa_StopStream(stream);
+    Pa_CloseStream(stream);
+    stop_workers();
+    stop_osc_server();
+    stop_telemetry();
+    return result;
 }
\ No newline at end of file